@@ -14,6 +14,22 @@ void CvCamera::read(cv::Mat &frame) { cam->read(frame); };
 void CvCamera::readWithDepth(cv::Mat &frame, cv::Mat &depth) { return read(frame); };
 bool CvCamera::isOpen() { return cam->isOpened(); };
 
+bool CvCamera::lensModel(cv::Mat &cameraMatrix, cv::Mat &distCoeffs, cv::Size &imageSize)
+{
+  if (this->cameraMatrix.empty()) return false;
+  cameraMatrix = this->cameraMatrix;
+  distCoeffs = this->distCoeffs;
+  imageSize = calibrationSize;
+  return true;
+};
+
+void CvCamera::setLensModel(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, cv::Size imageSize)
+{
+  this->cameraMatrix = cameraMatrix;
+  this->distCoeffs = distCoeffs;
+  calibrationSize = imageSize;
+};
+
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
 std::mutex camsMutex;
@@ -12,6 +12,9 @@ class Camera
     virtual void read(cv::Mat &frame) {};
     virtual void readWithDepth(cv::Mat &frame, cv::Mat &depth) {};
     virtual bool isOpen() { return true; };
+    // Intrinsics from a calibration, false if the camera is not calibrated
+    virtual bool lensModel(cv::Mat &cameraMatrix, cv::Mat &distCoeffs, cv::Size &imageSize) { return false; };
+    virtual void setLensModel(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, cv::Size imageSize) {};
 };
 
 class CvCamera : public Camera
@@ -21,8 +24,13 @@ class CvCamera : public Camera
     void read(cv::Mat&);
     void readWithDepth(cv::Mat &frame, cv::Mat &depth);
     bool isOpen();
+    bool lensModel(cv::Mat &cameraMatrix, cv::Mat &distCoeffs, cv::Size &imageSize);
+    void setLensModel(const cv::Mat &cameraMatrix, const cv::Mat &distCoeffs, cv::Size imageSize);
   private:
     std::unique_ptr<cv::VideoCapture> cam;
+    cv::Mat cameraMatrix;
+    cv::Mat distCoeffs;
+    cv::Size calibrationSize;
 };
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <fstream>
+#include <limits>
 
 #include <kinect-camera.hpp>
 
@@ -158,8 +159,14 @@ void KinectCamera::readWithDepth(cv::Mat &frame, cv::Mat &depth)
   frame.create(height, width, CV_8UC4);
   memcpy(frame.data, rgbFrame->data, height*width*4*sizeof(uchar));
 
-  depth.create(height, width, CV_32FC1);
-  memcpy(depth.data, bigDepthFrame.data, height*width*1*sizeof(float));
+  // the sensor resolves whole millimetres, no need to carry floats around.
+  // Invalid readings (inf, NaN) become 0 before that, what convertTo makes
+  // of them is up to cvRound
+  cv::Mat millimetres(height, width, CV_32FC1, bigDepthFrame.data);
+  float largest = std::numeric_limits<float>::max();
+  cv::Mat invalid = (millimetres > largest) | (millimetres < -largest) | (millimetres != millimetres);
+  millimetres.setTo(0, invalid);
+  millimetres.convertTo(depth, CV_16U);
 
   // imshow("depth", depth / 1000.0f);
   // imwrite("depth.exr", depth / 1000.0f);
@@ -172,7 +179,7 @@ void KinectCamera::readWithDepth(cv::Mat &frame, cv::Mat &depth)
     {
       for (int j = 0; j < width; j++)
       {
-        ss << depth.at<float>(i,j) << ",";
+        ss << depth.at<ushort>(i,j) << ",";
         // float val = depth.at<float>(i,j);
         // if (max < val) max = val;
         // if (min > val && val != 0) min = val;
@@ -0,0 +1,36 @@
+#ifndef BENCHMARKS_H_
+#define BENCHMARKS_H_
+
+#include <iostream>
+#include <string>
+#include <opencv2/opencv.hpp>
+#include "timer.hpp"
+
+// Runs fn iterations times and reports the mean in microseconds
+template<typename Functor>
+double benchmark(const std::string &name, int iterations, Functor fn)
+{
+  fn(); // warm up, e.g. caches and thread pools
+  auto total = timeToRunMicro([&]() { for (int i = 0; i < iterations; i++) fn(); });
+  double perRun = (double)total.count() / iterations;
+  std::cout << "  " << name << ": " << perRun << "us" << std::endl;
+  return perRun;
+}
+
+// What the benchmarks rely on: prints what is not so, main then fails
+bool check(bool ok, const std::string &what);
+
+// the depth diff mask of n hands reaching onto the table
+cv::Mat syntheticHandMask(cv::Size size, int n);
+
+void benchHandCount();
+void benchHandContour();
+void benchHandEvents();
+void benchHandJSON();
+void benchSharedMemory();
+void benchSockets();
+void benchDepthCodec();
+void benchDepthSampling();
+void benchProjectionModes();
+
+#endif  // BENCHMARKS_H_
@@ -0,0 +1,73 @@
+#include <cstdlib>
+#include "benchmarks.hpp"
+#include "vision/hand-contour.hpp"
+
+using cv::Mat;
+using cv::Point;
+using cv::Size;
+using PointV = std::vector<Point>;
+
+// Contours of a recording written by saveHandInput (set HAND_RECORDING to
+// its path): whatever is more than 20mm above the background
+static std::vector<PointV> recordedContours(const std::string &path, Size &size)
+{
+  cv::FileStorage fs(path, cv::FileStorage::READ);
+  Mat depth, depthBackground, diff;
+  fs["depth"] >> depth;
+  fs["depthBackground"] >> depthBackground;
+  fs.release();
+  if (depth.empty() || depthBackground.size() != depth.size()) {
+    std::cout << "  cannot read depth from " << path << std::endl;
+    return std::vector<PointV>();
+  }
+  cvhelper::depthToMillimeters(depth, depth);
+  cvhelper::depthToMillimeters(depthBackground, depthBackground);
+  absdiff(depth, depthBackground, diff);
+  Mat mask = diff > 20;
+  size = mask.size();
+  std::vector<PointV> contours;
+  cv::findContours(mask, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
+  return contours;
+}
+
+void benchHandContour()
+{
+  Size size(1280, 720);
+  std::vector<PointV> contours, candidates;
+  const char *recording = std::getenv("HAND_RECORDING");
+  if (recording) contours = recordedContours(recording, size);
+  else {
+    Mat mask = syntheticHandMask(size, 8);
+    cv::findContours(mask, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
+  }
+
+  // only what would reach findHandContour in the detector
+  for (auto &c : contours) if (c.size() >= 50) candidates.push_back(c);
+  std::vector<cv::RotatedRect> bounds;
+  for (auto &c : candidates) bounds.push_back(cv::fitEllipse(c));
+  std::cout << " " << candidates.size() << " contours" << std::endl;
+  if (candidates.empty()) return;
+
+  cv::Rect imageBounds(Point(0,0), size);
+  vision::hand::TableSpace table;
+  vision::hand::HandContour result;
+  benchmark("reference", 200, [&]() {
+    for (size_t i = 0; i < candidates.size(); i++)
+      vision::hand::findHandContourReference(candidates[i], bounds[i], imageBounds, table, result);
+  });
+  benchmark("single pass", 200, [&]() {
+    for (size_t i = 0; i < candidates.size(); i++)
+      vision::hand::findHandContour(candidates[i], bounds[i], imageBounds, table, result);
+  });
+
+  // the reference compares truncated distances, ties may pick another tip
+  int differing = 0;
+  for (size_t i = 0; i < candidates.size(); i++) {
+    vision::hand::HandContour a, b;
+    bool foundA = vision::hand::findHandContourReference(candidates[i], bounds[i], imageBounds, table, a),
+         foundB = vision::hand::findHandContour(candidates[i], bounds[i], imageBounds, table, b);
+    if (foundA != foundB || (foundA && (a.pointTowards != b.pointTowards || a.contourPoints != b.contourPoints)))
+      differing++;
+  }
+  std::cout << "  results differ for " << differing << " contours" << std::endl;
+}
@@ -0,0 +1,149 @@
+#include <cstdlib>
+#include "benchmarks.hpp"
+#include "vision/cv-helper.hpp"
+#include "vision/depth-codec.hpp"
+#include "vision/hand-detection.hpp"
+
+using cv::Mat;
+using cv::Size;
+
+// What the Kinect delivers: a table about 1.5m away, slightly tilted and
+// noisy, hands and arms above it and no readings (0) where the sensor did
+// not see anything
+static Mat syntheticDepth(Size size)
+{
+  Mat depth(size, CV_16UC1), noise(size, CV_16SC1);
+  cv::RNG rng(42);
+  rng.fill(noise, cv::RNG::NORMAL, 0, 2);
+  for (int y = 0; y < size.height; y++)
+    for (int x = 0; x < size.width; x++)
+      depth.at<ushort>(y, x) = cv::saturate_cast<ushort>(1450 + x / 40 + y / 30 + noise.at<short>(y, x));
+
+  Mat hands = syntheticHandMask(size, 4);
+  depth.setTo(cv::Scalar(0), hands);
+  cv::add(depth, cv::Scalar(1380), depth, hands);
+  for (int i = 0; i < 2000; i++)
+    cv::circle(depth, cv::Point(rng.uniform(0, size.width), rng.uniform(0, size.height)),
+               rng.uniform(1, 6), cv::Scalar(0), -1);
+  return depth;
+}
+
+// RVL has to give back exactly what went in, also frames without any
+// reading, jumps across the whole 16 bit range and crops that are not
+// continuous. Damaged records are rejected.
+static void checkRVL(const Mat &depth)
+{
+  Mat extremes = (cv::Mat_<ushort>(2, 4) << 0, 65535, 1, 0, 0, 65535, 0, 0), decoded;
+  std::vector<Mat> frames{depth, Mat::zeros(3, 5, CV_16UC1), extremes, Mat(depth, cv::Rect(3, 5, 101, 77))};
+  std::vector<uchar> encoded;
+  for (auto &frame : frames) {
+    vision::depth::encodeRVL(frame, encoded);
+    bool same = vision::depth::decodeRVL(&encoded[0], encoded.size(), decoded)
+             && decoded.size() == frame.size() && cv::countNonZero(decoded != frame) == 0;
+    check(same, "rvl round trip of " + std::to_string(frame.cols) + "x" + std::to_string(frame.rows));
+  }
+
+  vision::depth::encodeRVL(depth, encoded);
+  check(!vision::depth::decodeRVL(&encoded[0], encoded.size() / 2, decoded), "rvl rejects a truncated record");
+  encoded[0] ^= 1;
+  check(!vision::depth::decodeRVL(&encoded[0], encoded.size(), decoded), "rvl rejects another magic");
+}
+
+void benchDepthCodec()
+{
+  // a recording written by saveHandInput if HAND_RECORDING is set
+  Mat depth;
+  const char *recording = std::getenv("HAND_RECORDING");
+  if (recording) {
+    cv::FileStorage fs(recording, cv::FileStorage::READ);
+    fs["depth"] >> depth;
+    cvhelper::depthToMillimeters(depth, depth);
+  }
+  if (depth.empty()) depth = syntheticDepth(Size(1920, 1080));
+  double rawBytes = depth.total() * depth.elemSize();
+  std::cout << " " << depth.cols << "x" << depth.rows << std::endl;
+  checkRVL(depth);
+
+  std::vector<uchar> encoded;
+  for (auto encoding : {vision::depth::jpeg, vision::depth::png, vision::depth::rvl})
+  {
+    const char *name = encoding == vision::depth::jpeg ? "jpeg (8 bit)" : encoding == vision::depth::png ? "png" : "rvl";
+    double us = benchmark(name, 20, [&]() { vision::depth::encode(depth, encoding, encoded); });
+
+    Mat decoded;
+    if (encoding == vision::depth::rvl) vision::depth::decodeRVL(&encoded[0], encoded.size(), decoded);
+    else decoded = cv::imdecode(encoded, CV_LOAD_IMAGE_ANYDEPTH);
+    bool lossless = decoded.size() == depth.size() && decoded.type() == depth.type()
+                 && cv::countNonZero(decoded != depth) == 0;
+    std::cout << "   " << rawBytes / us << " MB/s, ratio " << rawBytes / encoded.size()
+              << (lossless ? ", lossless" : ", lossy") << std::endl;
+    if (encoding != vision::depth::jpeg) check(lossless, std::string(name) + " is lossless");
+  }
+}
+
+// How DepthSampler used to answer: an integral image of the whole frame's
+// |depth - background|, built once per frame, then four lookups per window
+static void sampleFromFullFrame(const Mat &depth, const Mat &depthBackground, int l,
+                                std::vector<vision::hand::Finger> &fingers)
+{
+  Mat diff, sums;
+  absdiff(depth, depthBackground, diff);
+  diff.convertTo(diff, CV_32F); // cv::integral takes 8 bit or float
+  cv::integral(diff, sums, CV_64F);
+  auto mean = [&sums](const cv::Rect &r) {
+    if (r.area() <= 0) return 0.0;
+    return (sums.at<double>(r.br()) - sums.at<double>(r.y, r.x + r.width)
+          - sums.at<double>(r.y + r.height, r.x) + sums.at<double>(r.tl())) / r.area();
+  };
+  for (auto &f : fingers) {
+    int x = std::min(depth.cols-1, std::max(f.tip.x-l, 0)),
+        y = std::min(depth.rows-1, std::max(f.tip.y-l, 0)),
+        w = std::min(2*l, depth.cols-x), h = std::min(2*l, depth.rows-y),
+        w2 = w/2, h2 = h/2;
+    f.z = std::max({mean(cv::Rect(x, y, w2, h2)), mean(cv::Rect(x + w2, y, w2, h2)),
+                    mean(cv::Rect(x + w2, y + h2, w2, h2)), mean(cv::Rect(x, y + h2, w2, h2)),
+                    mean(cv::Rect(x + w2/2, y + h2/2, w2, h2))});
+  }
+}
+
+void benchDepthSampling()
+{
+  Size size(1280, 720);
+  Mat depth = syntheticDepth(size), depthBackground(size, CV_16UC1, cv::Scalar(1450));
+
+  // five tips per hand, a finger width or two apart
+  cv::RNG rng(7);
+  std::vector<std::vector<vision::hand::Finger>> hands(8);
+  for (auto &hand : hands) {
+    cv::Point center(rng.uniform(100, size.width - 100), rng.uniform(100, size.height - 100));
+    for (int i = 0; i < 5; i++) {
+      cv::Point tip = center + cv::Point(rng.uniform(-40, 40), rng.uniform(-40, 40));
+      hand.push_back(vision::hand::Finger{tip, tip, tip, 0});
+    }
+  }
+
+  for (int l : {10, 30})
+  {
+    vision::hand::Options opts;
+    opts.depthSamplingKernelLength = l;
+    std::cout << " kernel length " << l << ", " << hands.size() << " hands" << std::endl;
+    vision::hand::DepthSampler sampler(depth, depthBackground, Mat(), opts);
+    auto direct = hands, perHand = hands, fullFrame = hands;
+
+    benchmark("direct means", 200, [&]() {
+      for (auto &hand : direct) for (auto &f : hand) f.z = sampler.at(f.tip);
+    });
+    benchmark("per hand", 200, [&]() {
+      for (auto &hand : perHand) sampler.sample(hand);
+    });
+    benchmark("full frame integral", 200, [&]() {
+      for (auto &hand : fullFrame) sampleFromFullFrame(depth, depthBackground, l, hand);
+    });
+
+    int differing = 0;
+    for (size_t i = 0; i < hands.size(); i++)
+      for (size_t j = 0; j < hands[i].size(); j++)
+        differing += direct[i][j].z != perHand[i][j].z || direct[i][j].z != fullFrame[i][j].z;
+    std::cout << "  depths differ for " << differing << " tips" << std::endl;
+  }
+}
@@ -0,0 +1,143 @@
+#include <memory>
+#include "benchmarks.hpp"
+#include "hand-events.hpp"
+
+// hand-detector-server's hand event queues (hand-events.hpp): which events
+// go out to clients that ack, to clients the transport holds back and to
+// clients that only want changes. Then what publishing a frame to a number
+// of subscribers costs, they share its encoding.
+
+using namespace handdetection::server;
+using std::vector;
+
+static HandEventPtr event(int n)
+{
+  vision::hand::FrameWithHands frame;
+  frame.time = n;
+  frame.imageSize = cv::Size(1280, 720);
+  return std::make_shared<HandEvent>(frame);
+}
+
+// the events a queue sent, by frame.time
+struct Sent
+{
+  vector<int> events;
+  OutboundQueue::Send send() { return [this](HandEvent &e) { events.push_back(e.frame.time); }; };
+};
+
+static void checkAcks()
+{
+  // two in flight, what comes meanwhile is coalesced into the newest
+  PublishOptions opts;
+  opts.ackWindow = 2;
+  Sent sent;
+  auto queue = std::make_shared<OutboundQueue>(sent.send(), opts);
+  for (int i = 1; i <= 5; i++) queue->offer(event(i), i * 0.01);
+  check(sent.events == vector<int>({1, 2}), "acks: window full after two events");
+  QueueStats stats = queue->stats();
+  check(stats.waiting && stats.coalesced == 2 && stats.inFlight == 2, "acks: the newest event waits, two coalesced");
+  queue->ack(1, 0.06);
+  check(sent.events == vector<int>({1, 2, 5}), "acks: an ack sends the newest event");
+  stats = queue->stats();
+  check(!stats.waiting && stats.inFlight == 2 && stats.sent == 3, "acks: nothing waits after the ack");
+  check(std::abs(stats.lagMs - 50) < 1e-6, "acks: lag from capture to ack");
+}
+
+static void checkAckTimeout()
+{
+  // acks that do not come do not stall the queue for good
+  PublishOptions opts;
+  opts.ackWindow = 1;
+  opts.ackTimeoutMs = 100;
+  Sent sent;
+  auto queue = std::make_shared<OutboundQueue>(sent.send(), opts);
+  queue->offer(event(1), 0);
+  queue->offer(event(2), 0.05);
+  check(sent.events == vector<int>({1}), "ack timeout: waits within the timeout");
+  queue->offer(event(3), 0.2);
+  QueueStats stats = queue->stats();
+  check(sent.events == vector<int>({1, 3}), "ack timeout: sends again after the timeout");
+  check(stats.dropped == 1 && stats.coalesced == 1 && stats.inFlight == 1 && !stats.waiting,
+        "ack timeout: the unacked event is dropped, the waiting one coalesced");
+  queue->ack(1, 0.25);
+  check(queue->stats().inFlight == 0, "ack timeout: a late ack still counts");
+}
+
+static void checkTransportBound()
+{
+  // without acks the transport's backlog holds events back until it wrote it
+  PublishOptions opts;
+  opts.maxQueued = 2;
+  Sent sent;
+  int queued = 0;
+  vector<std::function<void()>> watchers;
+  auto queue = std::make_shared<OutboundQueue>(sent.send(), opts,
+    [&]() { return queued; },
+    [&](std::function<void()> fn) { watchers.push_back(fn); });
+
+  queue->offer(event(1), 0.01);
+  queued = 2;
+  queue->offer(event(2), 0.02);
+  queue->offer(event(3), 0.03);
+  check(sent.events == vector<int>({1}) && watchers.size() == 1,
+        "transport: a full transport holds events back, watched once");
+  auto written = watchers.back(); // watching again adds to watchers
+  written();
+  check(sent.events == vector<int>({1}) && watchers.size() == 2,
+        "transport: still full after a write, watched again");
+  queued = 0;
+  written = watchers.back();
+  written();
+  QueueStats stats = queue->stats();
+  check(sent.events == vector<int>({1, 3}) && !stats.waiting && stats.coalesced == 1,
+        "transport: the newest event goes out once the transport caught up");
+  queue->offer(event(4), 0.04);
+  check(sent.events == vector<int>({1, 3, 4}), "transport: sends right away again");
+}
+
+static void checkChangesOnly()
+{
+  PublishOptions opts;
+  opts.changesOnly = true;
+  opts.heartbeatMs = 1000;
+  Sent sent;
+  Subscriber subscriber(sent.send(), opts, 0);
+  auto same = event(1);
+  subscriber.offer(same, 0);
+  subscriber.offer(same, 0.1);
+  check(sent.events == vector<int>({1}), "changes only: an unchanged frame is not sent");
+  auto moved = event(2);
+  vision::hand::HandData hand{};
+  hand.palmCenter = cv::Point(100, 100);
+  moved->frame.hands.push_back(hand);
+  subscriber.offer(moved, 0.2);
+  subscriber.offer(moved, 1.3);
+  check(sent.events == vector<int>({1, 2, 2}), "changes only: changes and heartbeats are sent");
+}
+
+void benchHandEvents()
+{
+  checkAcks();
+  checkAckTimeout();
+  checkTransportBound();
+  checkChangesOnly();
+
+  // a frame with a few hands to 16 JSON subscribers, encoded once for all
+  vision::hand::HandFields fields;
+  size_t bytes = 0;
+  vector<std::unique_ptr<Subscriber>> subscribers;
+  for (int i = 0; i < 16; i++)
+    subscribers.emplace_back(new Subscriber([&](HandEvent &e) { bytes += e.jsonText(fields).size(); }, PublishOptions(), 0));
+  vision::hand::HandData hand{};
+  hand.palmRadius = 50;
+  hand.contourBounds = cv::RotatedRect(cv::Point2f(300, 300), cv::Size2f(120, 260), 30);
+  for (int f = 0; f < 5; f++)
+    hand.fingerTips.push_back(vision::hand::Finger{cv::Point(f, 0), cv::Point(f, 2), cv::Point(f, 1), 40});
+  double time = 0;
+  benchmark("16 subscribers", 2000, [&]() {
+    auto e = event(0);
+    for (int i = 0; i < 4; i++) e->frame.hands.push_back(hand);
+    time += 0.04;
+    for (auto &s : subscribers) s->offer(e, time);
+  });
+}
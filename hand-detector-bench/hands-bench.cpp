@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <tuple>
+#include "benchmarks.hpp"
+#include "vision/blobs.hpp"
+#include "vision/hand-detection.hpp"
+
+using cv::Mat;
+using cv::Point;
+using cv::Size;
+
+// A depth diff mask with n hands reaching in from the table's edges: arm,
+// palm and a fan of fingers each. Plus speckles as the sensor produces them.
+Mat syntheticHandMask(Size size, int n)
+{
+  Mat mask = Mat::zeros(size, CV_8UC1);
+  int w = size.width, h = size.height, perimeter = 2*(w+h);
+  for (int i = 0; i < n; i++)
+  {
+    // spread the hands evenly along the border, pointing inwards
+    int along = (int)((i + 0.5) * perimeter / n);
+    Point start; cv::Point2f dir;
+    if (along < w)                { start = Point(along, 0);                 dir = cv::Point2f(0, 1); }
+    else if ((along -= w) < h)    { start = Point(w-1, along);               dir = cv::Point2f(-1, 0); }
+    else if ((along -= h) < w)    { start = Point(w-1-along, h-1);           dir = cv::Point2f(0, -1); }
+    else                          { along -= w; start = Point(0, h-1-along); dir = cv::Point2f(1, 0); }
+
+    Point palm = start + Point(dir * 220);
+    cv::line(mask, start, palm, cv::Scalar(255), 50);
+    cv::circle(mask, palm, 48, cv::Scalar(255), -1);
+    for (int f = -2; f <= 2; f++) {
+      double a = std::atan2(dir.y, dir.x) + f * 0.35;
+      Point tip = palm + Point(std::cos(a) * 110, std::sin(a) * 110);
+      cv::line(mask, palm, tip, cv::Scalar(255), 14);
+    }
+  }
+
+  cv::RNG rng(42);
+  for (int i = 0; i < 500; i++)
+    cv::circle(mask, Point(rng.uniform(0, w), rng.uniform(0, h)), rng.uniform(1, 4), cv::Scalar(255), -1);
+
+  return mask;
+}
+
+// blobs::Components against findContours: every 8-connected component has
+// one outer contour (RETR_CCOMP, no parent) with the bounds of its blob, and
+// the rendered blobs give back the mask
+static void checkBlobs(const Mat &mask, const std::string &what)
+{
+  vision::blobs::Components components;
+  components.label(mask);
+
+  // findContours ignores the outermost pixels, hands reach in from there
+  Mat padded;
+  cv::copyMakeBorder(mask, padded, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar(0));
+  std::vector<std::vector<Point>> contours;
+  std::vector<cv::Vec4i> hierarchy;
+  cv::findContours(padded, contours, hierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE);
+
+  auto key = [](const cv::Rect &r) { return std::make_tuple(r.y, r.x, r.width, r.height); };
+  std::vector<std::tuple<int, int, int, int>> fromContours, fromBlobs;
+  for (size_t i = 0; i < contours.size(); i++)
+    if (hierarchy[i][3] < 0) fromContours.push_back(key(cv::boundingRect(contours[i]) - Point(1, 1)));
+
+  Mat rendered = Mat::zeros(mask.size(), CV_8UC1), blob;
+  bool areas = true;
+  for (size_t i = 0; i < components.blobs().size(); i++) {
+    const vision::blobs::Blob &b = components.blobs()[i];
+    fromBlobs.push_back(key(b.bounds));
+    components.render(i, blob);
+    areas = areas && cv::countNonZero(blob) == b.area;
+    Mat target(rendered, b.bounds);
+    cv::bitwise_or(target, Mat(blob, cv::Rect(1, 1, b.bounds.width, b.bounds.height)), target);
+  }
+  std::sort(fromContours.begin(), fromContours.end());
+  std::sort(fromBlobs.begin(), fromBlobs.end());
+  check(fromBlobs == fromContours, what + ": blobs are the components findContours finds");
+  check(areas, what + ": blob areas are their rendered pixels");
+  check(cv::countNonZero(rendered != (mask != 0)) == 0, what + ": blobs cover the mask");
+}
+
+void benchHandCount()
+{
+  // a ring with a speckle inside, pixels that only touch diagonally and one
+  // in the corner that is not 255
+  Mat edgeCases = Mat::zeros(60, 80, CV_8UC1);
+  cv::circle(edgeCases, Point(30, 30), 20, cv::Scalar(255), 3);
+  edgeCases.at<uchar>(30, 30) = 255;
+  edgeCases.at<uchar>(5, 70) = edgeCases.at<uchar>(6, 71) = edgeCases.at<uchar>(7, 70) = 255;
+  edgeCases.at<uchar>(59, 79) = 1;
+  checkBlobs(edgeCases, "edge cases");
+
+  Size size(1280, 720);
+  vision::hand::Options opts;
+  opts.renderDebugImages = false;
+  opts.minHandAreaInPercent = 1.0f;
+
+  for (int n : {1, 2, 4, 8, 12, 16})
+  {
+    Mat mask = syntheticHandMask(size, n),
+        src = Mat::zeros(size, CV_8UC3),
+        depthBackground = Mat(size, CV_16UC1, cv::Scalar(1500)),
+        depth = depthBackground.clone(),
+        diffSmooth;
+    depth.setTo(cv::Scalar(1400), mask);
+    checkBlobs(mask, std::to_string(n) + " hands");
+
+    vision::hand::FrameWithHands hands;
+    std::cout << " " << n << " hands" << std::endl;
+    for (int threads : {1, cv::getNumberOfCPUs()}) {
+      cv::setNumThreads(threads);
+      benchmark(std::to_string(threads) + " thread(s)", 50, [&]() {
+        vision::hand::processFrame(src, depth, depthBackground, diffSmooth, mask, hands, opts);
+      });
+    }
+    std::cout << "  found " << hands.hands.size() << " hands" << std::endl;
+  }
+  cv::setNumThreads(-1);
+}
@@ -0,0 +1,125 @@
+#include "benchmarks.hpp"
+#include "vision/hand-detection.hpp"
+#include "json/json.h"
+
+using cv::Point;
+
+// n hands with five finger tips each, spread over a 1280x720 table
+static vision::hand::FrameWithHands syntheticFrame(int n)
+{
+  vision::hand::FrameWithHands frame;
+  frame.time = std::time(0);
+  frame.imageSize = cv::Size(1280, 720);
+  cv::RNG rng(n);
+  for (int i = 0; i < n; i++)
+  {
+    vision::hand::HandData hand;
+    hand.id = i + 1;
+    hand.palmRadius = rng.uniform(40, 80);
+    hand.palmCenter = Point(rng.uniform(0, 1280), rng.uniform(0, 720));
+    hand.contourBounds = cv::RotatedRect(hand.palmCenter, cv::Size2f(rng.uniform(80.f, 200.f), rng.uniform(150.f, 400.f)), rng.uniform(0.f, 180.f));
+    hand.convexityDefectArea = hand.contourBounds;
+    for (int f = 0; f < 5; f++) {
+      Point tip = hand.palmCenter + Point(rng.uniform(-120, 120), rng.uniform(-120, 120));
+      hand.fingerTips.push_back(vision::hand::Finger{tip + Point(-10, 30), tip + Point(10, 30), tip, rng.uniform(10, 200)});
+    }
+    frame.hands.push_back(hand);
+  }
+  return frame;
+}
+
+// Reads back what frameWithHandsToBinary documents, little-endian. Reading
+// past the end gives 0 and sets overrun.
+struct BinaryReader
+{
+  const std::vector<uchar> &in;
+  size_t at = 0;
+  bool overrun = false;
+  BinaryReader(const std::vector<uchar> &in) : in(in) {};
+  uint64_t u(int bytes)
+  {
+    if (at + bytes > in.size()) { overrun = true; return 0; }
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= (uint64_t)in[at++] << 8 * i;
+    return v;
+  }
+  int i16() { return (int16_t)u(2); }
+  Point point() { int x = i16(); return Point(x, i16()); }
+};
+
+static void checkBinaryLayout()
+{
+  // one hand with values that have to be rounded or clamped, one without tips
+  vision::hand::FrameWithHands frame;
+  frame.time = 1500000000;
+  frame.imageSize = cv::Size(1280, 720);
+  vision::hand::HandData hand;
+  hand.id = -7;
+  hand.palmRadius = 45;
+  hand.palmCenter = Point(-12, 40000);
+  hand.contourBounds = cv::RotatedRect(cv::Point2f(100.4f, 200.6f), cv::Size2f(80.6f, 150), 12.34f);
+  hand.fingerTips.push_back(vision::hand::Finger{Point(1, 2), Point(3, 4), Point(5, -6), 70});
+  hand.fingerTips.push_back(vision::hand::Finger{Point(7, 8), Point(9, 10), Point(11, 12), -1});
+  frame.hands.push_back(hand);
+  hand.id = 3;
+  hand.fingerTips.clear();
+  frame.hands.push_back(hand);
+
+  std::vector<uchar> out;
+  vision::hand::frameWithHandsToBinary(frame, out);
+  check(out.size() == vision::hand::handEventHeaderSize + 2 * 22 + 2 * 14, "binary hand frame size");
+
+  BinaryReader r(out);
+  check(r.u(4) == vision::hand::handEventMagic, "binary magic");
+  check(r.u(2) == vision::hand::handEventVersion, "binary version");
+  check(r.u(2) == 2, "binary number of hands");
+  check((int64_t)r.u(8) == 1500000000, "binary time");
+  check(r.i16() == 1280 && r.i16() == 720, "binary image size");
+
+  check(r.u(4) == (uint32_t)-7, "binary hand id");
+  check(r.i16() == 45, "binary palm radius");
+  check(r.point() == Point(-12, 32767), "binary palm center, clamped");
+  check(r.point() == Point(100, 201), "binary contour bounds center, rounded");
+  check(r.i16() == 81 && r.i16() == 150, "binary contour bounds size");
+  check(r.i16() == 123, "binary contour bounds angle");
+  check(r.u(1) == 2 && r.u(1) == 0, "binary number of tips");
+  check(r.point() == Point(1, 2) && r.point() == Point(3, 4) && r.point() == Point(5, -6) && r.i16() == 70,
+        "binary first finger tip");
+  check(r.point() == Point(7, 8) && r.point() == Point(9, 10) && r.point() == Point(11, 12) && r.i16() == -1,
+        "binary second finger tip");
+
+  check(r.u(4) == 3, "binary second hand id");
+  r.at += 16;
+  check(r.u(1) == 0 && r.u(1) == 0, "binary hand without tips");
+  check(!r.overrun && r.at == out.size(), "binary record ends after the last hand");
+}
+
+void benchHandJSON()
+{
+  checkBinaryLayout();
+
+  std::string direct;
+  // untracked hands (id 0) have no id, in both writers
+  auto untracked = syntheticFrame(2);
+  for (auto &hand : untracked.hands) hand.id = 0;
+  vision::hand::writeFrameWithHandsJSON(untracked, direct);
+  check(direct == Json::FastWriter().write(vision::hand::frameWithHandsToJSON(untracked))
+        && direct.find("\"id\"") == std::string::npos, "json of untracked hands");
+
+  for (int n : {1, 2, 4, 8, 16})
+  {
+    auto frame = syntheticFrame(n);
+    std::string viaValue = Json::FastWriter().write(vision::hand::frameWithHandsToJSON(frame));
+    vision::hand::writeFrameWithHandsJSON(frame, direct);
+    std::cout << " " << n << " hands, " << direct.size() << " bytes" << std::endl;
+    check(direct == viaValue, "json of " + std::to_string(n) + " hands, direct and via Json::Value");
+
+    benchmark("Json::Value + FastWriter", 2000, [&]() {
+      Json::FastWriter writer;
+      viaValue = writer.write(vision::hand::frameWithHandsToJSON(frame));
+    });
+    benchmark("writeFrameWithHandsJSON", 2000, [&]() {
+      vision::hand::writeFrameWithHandsJSON(frame, direct);
+    });
+  }
+}
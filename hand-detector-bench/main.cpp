@@ -0,0 +1,43 @@
+#include <functional>
+#include <map>
+#include "benchmarks.hpp"
+
+using std::string;
+
+static int failed = 0;
+
+bool check(bool ok, const string &what)
+{
+  if (!ok) {
+    failed++;
+    std::cout << "  FAILED: " << what << std::endl;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv)
+{
+  std::map<string, std::function<void()>> benchmarks{
+    {"depth-codec", benchDepthCodec},
+    {"depth-sampling", benchDepthSampling},
+    {"hand-count", benchHandCount},
+    {"hand-contour", benchHandContour},
+    {"hand-events", benchHandEvents},
+    {"hand-json", benchHandJSON},
+    {"projection-modes", benchProjectionModes},
+    {"shared-memory", benchSharedMemory},
+    {"sockets", benchSockets}
+  };
+
+  // run the benchmarks named as arguments or all of them
+  for (auto &b : benchmarks) {
+    bool selected = argc <= 1;
+    for (int i = 1; i < argc; i++) selected = selected || b.first == argv[i];
+    if (!selected) continue;
+    std::cout << b.first << std::endl;
+    b.second();
+  }
+
+  if (failed) std::cout << failed << " checks failed" << std::endl;
+  return failed ? 1 : 0;
+}
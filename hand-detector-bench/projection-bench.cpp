@@ -0,0 +1,151 @@
+#include <cstdlib>
+#include "benchmarks.hpp"
+#include "vision/cv-helper.hpp"
+#include "vision/hand-detection.hpp"
+#include "vision/warp-maps.hpp"
+
+using cv::Mat;
+using cv::Point;
+using cv::Size;
+
+// Hands found with the frames projected onto the table (warpFrames) and with
+// the frames left in camera space (points), as hand-detector-server's
+// recognizeHand does it. Both should find the same hands at about the same
+// table positions. Reads a recording written by saveHandInput if
+// HAND_RECORDING is set, otherwise a camera looks at the table at an angle.
+
+const float depthThreshold = 0.002f;
+
+struct Scene
+{
+  Mat rgb, depth, depthBackground, projection;
+  Size tableSize;
+};
+
+static bool recordedScene(const std::string &path, Scene &scene)
+{
+  cv::FileStorage fs(path, cv::FileStorage::READ);
+  fs["rgb"] >> scene.rgb;
+  fs["depth"] >> scene.depth;
+  fs["depthBackground"] >> scene.depthBackground;
+  fs["projection"] >> scene.projection;
+  fs.release();
+  if (scene.depth.empty() || scene.depth.size() != scene.rgb.size()
+   || scene.depthBackground.size() != scene.depth.size() || scene.projection.empty()) {
+    std::cout << "  cannot read rgb, depth and projection from " << path << std::endl;
+    return false;
+  }
+  cvhelper::depthToMillimeters(scene.depth, scene.depth);
+  cvhelper::depthToMillimeters(scene.depthBackground, scene.depthBackground);
+  scene.tableSize = scene.rgb.size();
+  return true;
+}
+
+static Scene syntheticScene()
+{
+  // the table shows up smaller than the camera frame and as a trapezoid
+  Scene scene;
+  Size cameraSize(1280, 720);
+  scene.tableSize = Size(960, 540);
+  cv::Point2f camera[] = {{170, 90}, {1120, 60}, {1210, 690}, {80, 650}},
+              table[] = {{0, 0}, {960, 0}, {960, 540}, {0, 540}};
+  scene.projection = cv::getPerspectiveTransform(camera, table);
+
+  Mat hands = syntheticHandMask(scene.tableSize, 4), onTable(scene.tableSize, CV_16UC1, cv::Scalar(1500));
+  onTable.setTo(cv::Scalar(1400), hands);
+  cv::warpPerspective(onTable, scene.depth, scene.projection, cameraSize,
+                      cv::INTER_NEAREST | cv::WARP_INVERSE_MAP, cv::BORDER_CONSTANT, cv::Scalar(1500));
+  scene.depthBackground = Mat(cameraSize, CV_16UC1, cv::Scalar(1500));
+  scene.rgb = Mat::zeros(cameraSize, CV_8UC4);
+  return scene;
+}
+
+static void projected(const Scene &scene, vision::hand::HandDetector &detector,
+                      const vision::hand::Options &opts, vision::hand::FrameWithHands &hands)
+{
+  auto maps = vision::warp::cachedPerspectiveMaps(scene.projection, scene.depth.size(), scene.tableSize);
+  Mat in, depth, bg, diff, diffSmooth, mask;
+  vision::warp::apply(scene.rgb, in, maps);
+  vision::warp::apply(scene.depth, depth, maps);
+  vision::warp::apply(scene.depthBackground, bg, maps);
+  absdiff(depth, bg, diff);
+  cv::compare(diff, depthThreshold * cv::norm(diff, cv::NORM_L2), mask, cv::CMP_GT);
+  detector.processFrame(in, depth, bg, diffSmooth, mask, hands, opts);
+}
+
+static void inCameraSpace(const Scene &scene, vision::hand::HandDetector &detector,
+                          const vision::hand::Options &opts, vision::hand::FrameWithHands &hands)
+{
+  cv::Rect roi = vision::warp::cachedInputRoi(scene.projection, scene.depth.size(), scene.tableSize);
+  Mat weights = vision::warp::cachedAreaWeights(scene.projection, scene.depth.size(), scene.tableSize);
+  auto outline = vision::warp::outline(scene.projection, scene.depth.size(), scene.tableSize);
+  for (auto &p : outline) p -= roi.tl();
+  vision::hand::TableSpace table{
+    outline, scene.projection, vision::warp::Lens(), scene.tableSize, roi.tl(), scene.depth.size()};
+  Mat in(scene.rgb, roi), depth(scene.depth, roi), bg(scene.depthBackground, roi),
+      diff, diffSmooth, mask;
+  absdiff(depth, bg, diff);
+  cv::compare(diff, depthThreshold * vision::warp::warpedNorm(diff, weights), mask, cv::CMP_GT);
+  detector.processFrame(in, depth, bg, diffSmooth, mask, hands, opts, Mat(), table);
+}
+
+static double distance(Point a, Point b) { return cv::norm(a - b); }
+
+void benchProjectionModes()
+{
+  Scene scene;
+  const char *recording = std::getenv("HAND_RECORDING");
+  if (!recording || !recordedScene(recording, scene)) scene = syntheticScene();
+  std::cout << " camera " << scene.depth.cols << "x" << scene.depth.rows
+            << ", table " << scene.tableSize.width << "x" << scene.tableSize.height << std::endl;
+
+  vision::hand::Options opts;
+  opts.renderDebugImages = false;
+  opts.minHandAreaInPercent = 1.0f;
+
+  // fresh detectors, tracking would skip the work after the first frame
+  vision::hand::FrameWithHands warped, points;
+  benchmark("warpFrames", 50, [&]() {
+    vision::hand::HandDetector detector;
+    projected(scene, detector, opts, warped);
+  });
+  benchmark("points", 50, [&]() {
+    vision::hand::HandDetector detector;
+    inCameraSpace(scene, detector, opts, points);
+  });
+
+  // palms and tips of the camera space hands, each against the closest one
+  // of the projected hands. In table pixels.
+  std::cout << "  hands: " << warped.hands.size() << " projected, " << points.hands.size() << " in camera space" << std::endl;
+  double palmMax = 0, palmSum = 0, tipMax = 0, tipSum = 0;
+  int tips = 0;
+  for (auto &h : points.hands) {
+    const vision::hand::HandData *closest = nullptr;
+    for (auto &w : warped.hands)
+      if (!closest || distance(w.palmCenter, h.palmCenter) < distance(closest->palmCenter, h.palmCenter))
+        closest = &w;
+    if (!closest) break;
+    double d = distance(closest->palmCenter, h.palmCenter);
+    palmMax = std::max(palmMax, d); palmSum += d;
+    for (auto &tip : h.fingerTips) {
+      double nearest = -1;
+      for (auto &other : closest->fingerTips)
+        if (nearest < 0 || distance(other.tip, tip.tip) < nearest) nearest = distance(other.tip, tip.tip);
+      if (nearest < 0) continue;
+      tipMax = std::max(tipMax, nearest); tipSum += nearest; tips++;
+    }
+  }
+  if (!points.hands.empty() && !warped.hands.empty())
+    std::cout << "  palm centers differ by " << palmSum / points.hands.size() << "px (max " << palmMax << "px)" << std::endl;
+  if (tips)
+    std::cout << "  finger tips differ by " << tipSum / tips << "px (max " << tipMax << "px)" << std::endl;
+
+  // the norm points thresholds with, from the projection's area, against
+  // the one warpFrames gets, of the nearest neighbor samples
+  auto maps = vision::warp::cachedPerspectiveMaps(scene.projection, scene.depth.size(), scene.tableSize);
+  Mat diff;
+  absdiff(Mat(scene.depth, maps.roi), Mat(scene.depthBackground, maps.roi), diff);
+  double sampled = vision::warp::warpedNorm(diff, maps),
+         area = vision::warp::warpedNorm(diff, vision::warp::cachedAreaWeights(scene.projection, scene.depth.size(), scene.tableSize));
+  std::cout << "  table space norm " << area << " from the area, " << sampled << " sampled" << std::endl;
+}
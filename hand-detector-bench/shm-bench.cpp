@@ -0,0 +1,107 @@
+#include "benchmarks.hpp"
+#include <atomic>
+#include <thread>
+#include <poll.h>
+#include <unistd.h>
+#include "shm-ring.hpp"
+
+// hand-detector-server's shared memory rings (shm-ring.hpp): a record from
+// RingWriter::write until a RingReader that waits for it in another thread
+// has read it, for hand frames and for images. Then the ring is replaced by a bigger
+// one, as when frames grow, and the reader has to notice.
+
+using namespace handdetection::server;
+using std::vector;
+
+static bool openReader(shm::RingWriter &writer, shm::RingReader &reader, const std::string &name)
+{
+  // the reader gets its eventfd when the writer writes next
+  std::atomic<bool> opened(false), ok(false);
+  std::thread opening([&]() { ok = reader.open(name); opened = true; });
+  uchar nothing = 0;
+  while (!opened) {
+    writer.write(shm::handFrame, 0, &nothing, 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  opening.join();
+  return ok && reader.notifier() >= 0;
+}
+
+static bool woken(const shm::RingReader &reader)
+{
+  pollfd fd{reader.notifier(), POLLIN, 0};
+  return poll(&fd, 1, 1000) == 1;
+}
+
+static void benchRecords(const std::string &name, size_t recordSize)
+{
+  shm::RingWriter writer;
+  shm::RingReader reader;
+  if (!writer.open(name, 8, sizeof(shm::SlotHeader) + recordSize) || !openReader(writer, reader, name)) {
+    std::cout << "  cannot open " << name << std::endl;
+    return;
+  }
+
+  // the reader waits for each record, the writer for the reader
+  vector<uchar> record(recordSize), copy(recordSize);
+  long mismatches = 0, missed = 0;
+  std::atomic<bool> done(false);
+  std::atomic<uint64_t> consumed(reader.written());
+  std::thread reading([&]() {
+    uint64_t index = consumed;
+    while (!done) {
+      if (!reader.wait(index, 10)) continue;
+      bool read = reader.read(index, [&](const shm::SlotHeader &slot, const uchar *payload) {
+        std::copy(payload, payload + slot.size, copy.begin());
+      });
+      if (!read) missed++;
+      else if (copy != record) mismatches++;
+      consumed = ++index;
+    }
+  });
+  uchar value = 0;
+  double us = benchmark(std::to_string(recordSize / 1024) + "KB records", 2000, [&]() {
+    std::fill(record.begin(), record.end(), ++value);
+    uint64_t index = consumed;
+    writer.write(shm::image, 0, record.data(), record.size());
+    while (consumed <= index) std::this_thread::yield();
+  });
+  done = true;
+  reading.join();
+  std::cout << "   " << recordSize / us << " MB/s, " << missed << " missed, "
+            << mismatches << " not what was written" << std::endl;
+}
+
+static void benchReplaced(const std::string &name)
+{
+  shm::RingWriter writer;
+  shm::RingReader reader;
+  if (!writer.open(name, 4, 1024) || !openReader(writer, reader, name)) {
+    std::cout << "  cannot open " << name << std::endl;
+    return;
+  }
+
+  vector<uchar> big(4096, 42);
+  writer.open(name, 4, sizeof(shm::SlotHeader) + big.size());
+  bool wokenUp = woken(reader), closed = reader.closed();
+  uint64_t before = reader.written();
+
+  // a client that reopens gets the new ring
+  shm::RingReader reopened;
+  bool reopenedOk = openReader(writer, reopened, name);
+  uint64_t index = reopened.written();
+  writer.write(shm::image, 0, big.data(), big.size());
+  bool readBig = reopened.wait(index, 1000) && reopened.read(index,
+    [&](const shm::SlotHeader &slot, const uchar*) {}) && reader.written() == before;
+  std::cout << "  replaced ring: reader " << (wokenUp ? "woken" : "not woken")
+            << ", " << (closed ? "sees closed" : "does not see closed")
+            << ", reopening " << (reopenedOk && readBig ? "works" : "fails") << std::endl;
+}
+
+void benchSharedMemory()
+{
+  std::string name = "/hand-detector-bench";
+  benchRecords(name, 1536);          // a frame with 16 hands
+  benchRecords(name, 640 * 480 * 4); // a BGRA frame
+  benchReplaced(name);
+}
@@ -0,0 +1,206 @@
+#include "benchmarks.hpp"
+#include <array>
+#include <atomic>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <boost/asio.hpp>
+#include <boost/beast/core.hpp>
+#include <boost/beast/websocket.hpp>
+#include "l2l.hpp"
+#include "unix-socket.hpp"
+
+// Request round trip and upload throughput over TCP loopback and a Unix
+// domain socket, framed as hand-detector-server's Unix socket does it (see
+// unix-socket.hpp): kind byte, uint32 size, payload. The echo server answers
+// each frame with a small JSON frame, as services answer "OK".
+//
+// Then the same request through the servers themselves: l2l's websocket
+// server, which TCP clients talk to, against UnixSocketServer. Both serve one
+// service that answers "OK", so what is measured is listener, parsing and
+// dispatch.
+
+using boost::asio::ip::tcp;
+using boost::asio::local::stream_protocol;
+using std::string;
+using std::vector;
+namespace websocket = boost::beast::websocket;
+
+typedef unsigned char uchar;
+
+template<typename Socket>
+void writeFrame(Socket &socket, uchar kind, const vector<uchar> &payload)
+{
+  uchar header[5] = {kind};
+  for (int i = 0; i < 4; i++) header[1 + i] = (uchar)(payload.size() >> (8 * i));
+  std::array<boost::asio::const_buffer, 2> buffers{{
+    boost::asio::buffer(header), boost::asio::buffer(payload)}};
+  boost::asio::write(socket, buffers);
+}
+
+template<typename Socket>
+bool readFrame(Socket &socket, vector<uchar> &payload)
+{
+  uchar header[5];
+  boost::system::error_code err;
+  boost::asio::read(socket, boost::asio::buffer(header), err);
+  if (err) return false;
+  uint32_t size = 0;
+  for (int i = 0; i < 4; i++) size |= (uint32_t)header[1 + i] << (8 * i);
+  payload.resize(size);
+  boost::asio::read(socket, boost::asio::buffer(payload), err);
+  return !err;
+}
+
+template<typename Socket>
+void echo(Socket &socket)
+{
+  string ok = "{\"action\":\"hand-detectionResult\",\"data\":\"OK\"}";
+  vector<uchar> in, answer(ok.begin(), ok.end());
+  while (readFrame(socket, in)) writeFrame(socket, 'j', answer);
+}
+
+template<typename Socket>
+void benchRequests(const string &name, Socket &socket)
+{
+  string request = "{\"action\":\"hand-detection\",\"sender\":\"bench\",\"messageId\":1,"
+                   "\"data\":{\"maxWidth\":640,\"maxHeight\":480,\"projection\":[1,0,0,0,1,0,0,0,1]}}";
+  vector<uchar> msg(request.begin(), request.end()), answer;
+  benchmark(name + " round trip", 5000, [&]() {
+    writeFrame(socket, 'j', msg);
+    readFrame(socket, answer);
+  });
+
+  // an upload is a binary frame followed by the message that uses it
+  for (size_t size : {64 * 1024, 1024 * 1024}) {
+    vector<uchar> upload(size, 42);
+    double us = benchmark(name + " upload " + std::to_string(size / 1024) + "KB", 200, [&]() {
+      writeFrame(socket, 'b', upload);
+      writeFrame(socket, 'j', msg);
+      readFrame(socket, answer); readFrame(socket, answer);
+    });
+    std::cout << "   " << size / us << " MB/s" << std::endl;
+  }
+}
+
+const string serverId = "hand-detector-bench";
+const string request = "{\"action\":\"bench-echo\",\"target\":\"" + serverId + "\","
+                       "\"sender\":\"bench-client\",\"messageId\":1,"
+                       "\"data\":{\"maxWidth\":640,\"maxHeight\":480,\"projection\":[1,0,0,0,1,0,0,0,1]}}";
+
+static bool answered(websocket::stream<tcp::socket> &ws, boost::beast::flat_buffer &buffer)
+{
+  // l2l may send other messages, the answer is the one in response
+  boost::system::error_code err;
+  while (true) {
+    buffer.consume(buffer.size());
+    ws.read(buffer, err);
+    if (err) return false;
+    if (boost::beast::buffers_to_string(buffer.data()).find("\"inResponseTo\"") != string::npos) return true;
+  }
+}
+
+static void benchL2l(const l2l::Services &services)
+{
+  // a free port, l2l::startServer serves until the process ends
+  boost::asio::io_service io;
+  unsigned short port;
+  {
+    tcp::acceptor probe(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    port = probe.local_endpoint().port();
+  }
+  std::thread([=]() { l2l::startServer("127.0.0.1", port, serverId, services); }).detach();
+
+  websocket::stream<tcp::socket> ws(io);
+  boost::system::error_code err;
+  for (int i = 0; i < 50; i++) {
+    ws.next_layer().connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port), err);
+    if (!err) break;
+    ws.next_layer().close();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  if (!err) ws.handshake("127.0.0.1:" + std::to_string(port), "/", err);
+  if (err) { std::cout << "  cannot connect to l2l: " << err.message() << std::endl; return; }
+  ws.next_layer().set_option(tcp::no_delay(true));
+  ws.text(true);
+
+  // no answer within a second: shut the socket down, the read fails
+  boost::beast::flat_buffer buffer;
+  std::atomic<bool> first(false);
+  std::thread watchdog([&]() {
+    for (int i = 0; i < 100 && !first; i++) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (!first) ::shutdown(ws.next_layer().native_handle(), SHUT_RDWR);
+  });
+  ws.write(boost::asio::buffer(request), err);
+  first = !err && answered(ws, buffer);
+  watchdog.join();
+  if (!first) { std::cout << "  l2l does not answer" << std::endl; return; }
+
+  benchmark("l2l server round trip", 5000, [&]() {
+    ws.write(boost::asio::buffer(request));
+    answered(ws, buffer);
+  });
+  ws.close(websocket::close_code::normal, err);
+}
+
+static void benchUnixSocketServer(const std::map<string, handdetection::server::Service> &services)
+{
+  string path = "/tmp/hand-detector-bench-server.sock";
+  handdetection::server::UnixSocketServer server(path, serverId, services, [](const string&) {});
+  server.start();
+
+  boost::asio::io_service io;
+  stream_protocol::socket client(io);
+  client.connect(stream_protocol::endpoint(path));
+  vector<uchar> msg(request.begin(), request.end()), answer;
+  benchmark("unix socket server round trip", 5000, [&]() {
+    writeFrame(client, 'j', msg);
+    readFrame(client, answer);
+  });
+  client.close();
+}
+
+void benchSockets()
+{
+  boost::asio::io_service io;
+
+  {
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    tcp::socket server(io), client(io);
+    std::thread serving([&]() {
+      acceptor.accept(server);
+      server.set_option(tcp::no_delay(true));
+      echo(server);
+    });
+    client.connect(acceptor.local_endpoint());
+    client.set_option(tcp::no_delay(true));
+    benchRequests("tcp loopback", client);
+    client.close();
+    serving.join();
+  }
+
+  {
+    string path = "/tmp/hand-detector-bench.sock";
+    ::unlink(path.c_str());
+    stream_protocol::acceptor acceptor(io, stream_protocol::endpoint(path));
+    stream_protocol::socket server(io), client(io);
+    std::thread serving([&]() {
+      acceptor.accept(server);
+      echo(server);
+    });
+    client.connect(stream_protocol::endpoint(path));
+    benchRequests("unix socket", client);
+    client.close();
+    serving.join();
+    ::unlink(path.c_str());
+  }
+
+  using namespace handdetection::server;
+  std::map<string, Service> services{
+    {"bench-echo", [](Json::Value msg, Server server) { server->answer(msg, Json::Value("OK")); }}};
+  l2l::Services l2lServices;
+  for (auto &service : services)
+    l2lServices.push_back(l2l::createLambdaService(service.first, viaL2l(service.second)));
+  benchUnixSocketServer(services);
+  benchL2l(l2lServices);
+}
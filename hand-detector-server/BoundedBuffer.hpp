@@ -3,6 +3,7 @@
 
 #include <mutex>
 #include <condition_variable>
+#include <utility>
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // http://baptiste-wicht.com/posts/2012/04/c11-concurrency-tutorial-advanced-locking-and-condition-variables.html
@@ -31,26 +32,26 @@ struct BoundedBuffer
     delete[] buffer;
   }
 
-  void deposit(int data)
+  void deposit(T data)
   {
     std::unique_lock<std::mutex> l(lock);
 
     not_full.wait(l, [this](){ return count != capacity; });
 
-    buffer[rear] = data;
+    buffer[rear] = std::move(data);
     rear = (rear + 1) % capacity;
     ++count;
 
     not_empty.notify_one();
   }
 
-  int fetch()
+  T fetch()
   {
     std::unique_lock<std::mutex> l(lock);
 
     not_empty.wait(l, [this](){ return count != 0; });
 
-    int result = buffer[front];
+    T result = std::move(buffer[front]);
     front = (front + 1) % capacity;
     --count;
 
@@ -64,7 +65,7 @@ struct BoundedBuffer
 /* -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 USAGE
 
-void consumer(int id, BoundedBuffer& buffer){
+void consumer(int id, BoundedBuffer<int>& buffer){
     for(int i = 0; i < 50; ++i){
         int value = buffer.fetch();
         std::cout << "Consumer " << id << " fetched " << value << std::endl;
@@ -72,7 +73,7 @@ void consumer(int id, BoundedBuffer& buffer){
     }
 }
 
-void producer(int id, BoundedBuffer& buffer){
+void producer(int id, BoundedBuffer<int>& buffer){
     for(int i = 0; i < 75; ++i){
         buffer.deposit(i);
         std::cout << "Produced " << id << " produced " << i << std::endl;
@@ -81,7 +82,7 @@ void producer(int id, BoundedBuffer& buffer){
 }
 
 int main(){
-    BoundedBuffer buffer(200);
+    BoundedBuffer<int> buffer(200);
 
     std::thread c1(consumer, 0, std::ref(buffer));
     std::thread c2(consumer, 1, std::ref(buffer));
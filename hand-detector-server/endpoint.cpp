@@ -0,0 +1,77 @@
+#include "endpoint.hpp"
+
+namespace handdetection {
+namespace server {
+
+std::recursive_mutex &serviceLock()
+{
+  static std::recursive_mutex lock;
+  return lock;
+}
+
+static Json::Value parsed(const std::string &data)
+{
+  Json::Value value;
+  Json::Reader().parse(data, value);
+  return value;
+}
+
+void Endpoint::answerJSON(Json::Value &msg, const std::string &data, bool expectMore)
+{
+  answer(msg, parsed(data), expectMore);
+}
+
+void Endpoint::sendJSON(const Json::Value &msg, const std::string &data)
+{
+  Json::Value withData = msg;
+  withData["data"] = parsed(data);
+  send(withData);
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+class L2lEndpoint : public Endpoint
+{
+  public:
+    L2lEndpoint(std::shared_ptr<l2l::L2lServer> server) : server(server) {};
+
+    void answer(Json::Value &msg, const Json::Value &data, bool expectMore)
+    {
+      server->answer(msg, data, expectMore);
+    }
+
+    void send(const Json::Value &msg) { server->send(msg); }
+
+    void sendBinary(const std::string &target, const uchar *data, size_t size, std::function<void()> written)
+    {
+      server->sendBinary(target, const_cast<uchar*>(data), size);
+      if (written) written();
+    }
+
+    bool takeUploadedBinaryData(const std::string &sender, std::vector<uchar> &data)
+    {
+      auto uploaded = server->getUploadedBinaryDataOf(sender);
+      server->clearUploadedBinaryDataOf(sender);
+      if (uploaded.empty()) return false;
+      data.assign(uploaded[0]->data, uploaded[0]->data + uploaded[0]->size);
+      return true;
+    }
+
+    void setTimer(int ms, std::function<void()> fn)
+    {
+      server->setTimer(ms, fn);
+    }
+
+  private:
+    std::shared_ptr<l2l::L2lServer> server;
+};
+
+std::function<void(Json::Value, std::shared_ptr<l2l::L2lServer>)> viaL2l(Service service)
+{
+  return [service](Json::Value msg, std::shared_ptr<l2l::L2lServer> server) {
+    service(msg, std::make_shared<L2lEndpoint>(server));
+  };
+}
+
+}
+}
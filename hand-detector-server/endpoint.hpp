@@ -0,0 +1,68 @@
+#ifndef HAND_DETECTOR_SERVER_ENDPOINT_H_
+#define HAND_DETECTOR_SERVER_ENDPOINT_H_
+
+/*
+What services talk back to: the l2l server for clients connected over TCP,
+a connection of the UnixSocketServer for local ones. Both speak the same
+messages, services do not need to know which one they got.
+*/
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "json/json.h"
+#include "l2l.hpp"
+
+namespace handdetection {
+namespace server {
+
+typedef unsigned char uchar;
+
+class Endpoint
+{
+  public:
+    virtual ~Endpoint() {};
+    virtual void answer(Json::Value &msg, const Json::Value &data, bool expectMore = false) = 0;
+    virtual void send(const Json::Value &msg) = 0;
+    // written: called once the socket took the data, where the endpoint can
+    // tell (Unix socket), otherwise once it is handed over (l2l)
+    virtual void sendBinary(const std::string &target, const uchar *data, size_t size,
+                            std::function<void()> written = nullptr) = 0;
+    // the binary data sender uploaded before its message, if any. Cleared
+    // afterwards.
+    virtual bool takeUploadedBinaryData(const std::string &sender, std::vector<uchar> &data) = 0;
+    virtual void setTimer(int ms, std::function<void()> fn) = 0;
+    // messages for target handed to the endpoint but not written to the
+    // client yet, -1 if the endpoint cannot tell (l2l)
+    virtual int queuedFor(const std::string &target) { return -1; }
+    // calls fn once the messages for target handed over so far are written,
+    // never if the endpoint cannot tell (l2l)
+    virtual void whenWritten(const std::string &target, std::function<void()> fn) {}
+
+    // answer and send with data that is JSON text already, see
+    // writeFrameWithHandsJSON. Endpoints that write messages themselves
+    // (writesJSON) put it in as it is, others parse it first.
+    virtual void answerJSON(Json::Value &msg, const std::string &data, bool expectMore = false);
+    virtual void sendJSON(const Json::Value &msg, const std::string &data);
+    virtual bool writesJSON() const { return false; }
+};
+
+typedef std::shared_ptr<Endpoint> Server;
+typedef std::function<void(Json::Value, Server)> Service;
+
+// Guards the streams and subscribers that services and their timers share,
+// whichever listener they came in from. Services take it only around what
+// they do with those, not for capturing or detecting: a slow one must not
+// hold up the other clients.
+std::recursive_mutex &serviceLock();
+
+// a service as l2l::createLambdaService wants it
+std::function<void(Json::Value, std::shared_ptr<l2l::L2lServer>)> viaL2l(Service service);
+
+}
+}
+
+#endif  // HAND_DETECTOR_SERVER_ENDPOINT_H_
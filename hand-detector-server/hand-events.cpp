@@ -0,0 +1,188 @@
+#include "hand-events.hpp"
+
+namespace handdetection {
+namespace server {
+
+using vision::hand::FrameWithHands;
+using vision::hand::HandData;
+
+bool moved(const cv::Point &a, const cv::Point &b, float epsilon)
+{
+  cv::Point d = a - b;
+  return d.x*d.x + d.y*d.y > epsilon*epsilon;
+}
+
+bool handChanged(const HandData &a, const HandData &b, float epsilon)
+{
+  if (a.id != b.id || moved(a.palmCenter, b.palmCenter, epsilon)) return true;
+  if (a.fingerTips.size() != b.fingerTips.size()) return true;
+  for (size_t i = 0; i < a.fingerTips.size(); i++) {
+    auto &f = a.fingerTips[i], &g = b.fingerTips[i];
+    if (moved(f.tip, g.tip, epsilon) || std::abs(f.z - g.z) > epsilon) return true;
+  }
+  return false;
+}
+
+bool ChangeFilter::changed(const FrameWithHands &frame, float epsilon) const
+{
+  if (frame.hands.size() != last.hands.size()) return true;
+  for (size_t i = 0; i < frame.hands.size(); i++)
+  {
+    // tracked hands are compared to their last self, wherever the detector
+    // listed them
+    const HandData &hand = frame.hands[i], *before = &last.hands[i];
+    if (hand.id != 0)
+      for (auto &h : last.hands)
+        if (h.id == hand.id) { before = &h; break; }
+    if (handChanged(hand, *before, epsilon)) return true;
+  }
+  return false;
+}
+
+bool ChangeFilter::shouldPublish(const FrameWithHands &frame, double time, const PublishOptions &opts)
+{
+  bool publish = !opts.changesOnly || !published
+              || time - lastPublished >= opts.heartbeatMs / 1000.0
+              || changed(frame, opts.epsilon);
+  if (publish) {
+    published = true;
+    lastPublished = time;
+    last = frame;
+  }
+  return publish;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+const Json::Value& HandEvent::json(const vision::hand::HandFields &fields)
+{
+  std::lock_guard<std::mutex> l(mutex);
+  auto found = jsonByFields.find(fields.key());
+  if (found != jsonByFields.end()) return found->second;
+  return jsonByFields[fields.key()] = vision::hand::frameWithHandsToJSON(frame, fields);
+}
+
+const std::string& HandEvent::jsonText(const vision::hand::HandFields &fields)
+{
+  {
+    std::lock_guard<std::mutex> l(mutex);
+    auto found = textByFields.find(fields.key());
+    if (found != textByFields.end()) return found->second;
+    if (fields.key() == vision::hand::HandFields().key()) {
+      std::string &text = textByFields[fields.key()];
+      vision::hand::writeFrameWithHandsJSON(frame, text);
+      return text;
+    }
+  }
+  std::string text = Json::FastWriter().write(json(fields));
+  std::lock_guard<std::mutex> l(mutex);
+  return textByFields[fields.key()] = text;
+}
+
+std::vector<uchar>& HandEvent::binary()
+{
+  std::lock_guard<std::mutex> l(mutex);
+  if (encoded.empty()) vision::hand::frameWithHandsToBinary(frame, encoded);
+  return encoded;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+void OutboundQueue::sendNow(const HandEventPtr &event, double time)
+{
+  send(*event);
+  counts.sent++;
+  if (window > 0) inFlight.push_back(time);
+}
+
+void OutboundQueue::offer(const HandEventPtr &event, double time)
+{
+  std::lock_guard<std::mutex> l(mutex);
+
+  // acks that do not come are lost, not a reason to stall for good
+  if (!inFlight.empty() && time - std::max(lastAck, inFlight.front()) > ackTimeout) {
+    counts.dropped += inFlight.size();
+    inFlight.clear();
+  }
+
+  bool full = window > 0 ? (int)inFlight.size() >= window : transportFull();
+  if (!full) {
+    if (waiting) counts.coalesced++;
+    waiting = false;
+    waitingEvent.reset();
+    sendNow(event, time);
+    return;
+  }
+
+  // the client is behind, it gets the newest frame once it catches up. With
+  // acks that is when the ack comes, otherwise when the transport wrote what
+  // it has (or with the next frame offered, if it cannot tell)
+  if (waiting) counts.coalesced++;
+  waiting = true;
+  waitingEvent = event;
+  waitingTime = time;
+  if (window == 0) watchTransport();
+}
+
+bool OutboundQueue::transportFull() const
+{
+  return maxQueued > 0 && queued && queued() >= maxQueued;
+}
+
+void OutboundQueue::watchTransport()
+{
+  if (watching || !whenWritten) return;
+  watching = true;
+  std::weak_ptr<OutboundQueue> self = shared_from_this();
+  whenWritten([self]() { if (auto queue = self.lock()) queue->written(); });
+}
+
+void OutboundQueue::written()
+{
+  std::lock_guard<std::mutex> l(mutex);
+  watching = false;
+  if (!waiting || window > 0) return;
+  if (transportFull()) { watchTransport(); return; }
+  waiting = false;
+  sendNow(waitingEvent, waitingTime);
+  waitingEvent.reset();
+}
+
+void OutboundQueue::ack(int count, double time)
+{
+  std::lock_guard<std::mutex> l(mutex);
+  lastAck = time;
+  for (; count > 0 && !inFlight.empty(); count--) {
+    double lagMs = (time - inFlight.front()) * 1000;
+    inFlight.pop_front();
+    counts.lagMs = counts.lagMs == 0 ? lagMs : counts.lagMs * 0.9 + lagMs * 0.1;
+    counts.maxLagMs = std::max(counts.maxLagMs, lagMs);
+  }
+  if (waiting && (int)inFlight.size() < window) {
+    waiting = false;
+    sendNow(waitingEvent, waitingTime);
+    waitingEvent.reset();
+  }
+}
+
+QueueStats OutboundQueue::stats()
+{
+  std::lock_guard<std::mutex> l(mutex);
+  QueueStats result = counts;
+  result.inFlight = inFlight.size();
+  result.waiting = waiting;
+  return result;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+void Subscriber::offer(const HandEventPtr &event, double time)
+{
+  if (lastOffered >= 0 && time - lastOffered < minInterval) return;
+  if (!changes.shouldPublish(event->frame, time, opts)) return;
+  lastOffered = time;
+  outbound->offer(event, time);
+}
+
+}
+}
@@ -0,0 +1,160 @@
+#ifndef HAND_DETECTOR_SERVER_HAND_EVENTS_H_
+#define HAND_DETECTOR_SERVER_HAND_EVENTS_H_
+
+/*
+What of the hand frames of a stream goes out to its client. Most of the time
+nobody touches the table or hands rest on it, then frame after frame is the
+same. Clients can ask for only the frames that differ from the last one sent
+(changesOnly), plus a heartbeat now and then so that they know the stream is
+alive. By default every frame is published.
+
+Clients that read slowly would make events pile up in the server, arriving
+seconds late. Streams can ask for flow control: at most ackWindow events are
+on their way before the client acks one, newer events replace the one that
+waits (OutboundQueue). Clients that do not ack are held back once the
+transport has maxQueued of their messages (an event is one or two) it did
+not write yet (Endpoint::queuedFor). Meanwhile the newest frame waits and
+goes out once the transport wrote what it held. Only transports that know
+what they wrote can do that, the Unix socket does. l2l cannot tell, its TCP
+clients are bounded only with acks, without them their queue is l2l's and
+unbounded.
+
+Other clients can subscribe to a running stream. Each Subscriber has its own
+rate, field selection and encoding. A frame is encoded at most once per
+selection (HandEvent), subscribers that want the same share it.
+*/
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "json/json.h"
+#include "vision/hand-detection.hpp"
+
+namespace handdetection {
+namespace server {
+
+struct PublishOptions
+{
+  bool changesOnly = false; // true: only frames that changed, and heartbeats
+  float epsilon = 2;       // pixels (mm for z) a palm or tip has to move
+  int heartbeatMs = 1000;  // without changes publish at least this often
+  int ackWindow = 0;       // events in flight before the client acks, 0 = no acks
+  int ackTimeoutMs = 2000; // give up on events not acked for this long
+  int maxQueued = 4;       // without acks: messages not written yet, 0 = no
+                           // limit. Not for l2l clients, see above
+};
+
+class ChangeFilter
+{
+  public:
+    // time: seconds. Frames are compared to the last published one, slow
+    // drift adds up until it is published.
+    bool shouldPublish(const vision::hand::FrameWithHands&, double time, const PublishOptions&);
+
+  private:
+    bool changed(const vision::hand::FrameWithHands&, float epsilon) const;
+
+    bool published = false;
+    double lastPublished = 0;
+    vision::hand::FrameWithHands last;
+};
+
+// A frame that goes out to the subscribers of a stream, with its encodings
+// once somebody asked for them
+class HandEvent
+{
+  public:
+    HandEvent(const vision::hand::FrameWithHands &frame) : frame(frame) {};
+    const Json::Value& json(const vision::hand::HandFields&);
+    // the same as text, for endpoints that write JSON themselves. All fields
+    // are written directly (writeFrameWithHandsJSON), without a Json::Value
+    const std::string& jsonText(const vision::hand::HandFields&);
+    std::vector<uchar>& binary();
+
+    vision::hand::FrameWithHands frame;
+
+  private:
+    std::mutex mutex;
+    std::map<int, Json::Value> jsonByFields; // HandFields::key()
+    std::map<int, std::string> textByFields;
+    std::vector<uchar> encoded;
+};
+
+using HandEventPtr = std::shared_ptr<HandEvent>;
+
+struct QueueStats
+{
+  long sent = 0;
+  long coalesced = 0; // replaced by a newer event before they were sent
+  long dropped = 0;   // sent but never acked (ackTimeoutMs)
+  int inFlight = 0;
+  bool waiting = false; // an event waits for the client to ack
+  double lagMs = 0;     // capture to ack, smoothed
+  double maxLagMs = 0;
+};
+
+class OutboundQueue : public std::enable_shared_from_this<OutboundQueue>
+{
+  public:
+    using Send = std::function<void(HandEvent&)>;
+    // how many sent messages the transport still holds, < 0 if it cannot tell
+    using Queued = std::function<int()>;
+    // calls back once the transport wrote the messages it holds now
+    using WhenWritten = std::function<void(std::function<void()>)>;
+
+    OutboundQueue(Send send, const PublishOptions &opts,
+                  Queued queued = Queued(), WhenWritten whenWritten = WhenWritten())
+      : send(send), queued(queued), whenWritten(whenWritten), window(opts.ackWindow),
+        maxQueued(opts.maxQueued), ackTimeout(opts.ackTimeoutMs / 1000.0) {};
+    // time: seconds, when the frame was captured / the ack came in
+    void offer(const HandEventPtr&, double time);
+    void ack(int count, double time);
+    // the transport caught up, the waiting event can go
+    void written();
+    QueueStats stats();
+
+  private:
+    void sendNow(const HandEventPtr&, double time);
+    bool transportFull() const;
+    void watchTransport();
+
+    Send send;
+    Queued queued;
+    WhenWritten whenWritten;
+    int window, maxQueued;
+    double ackTimeout;
+    std::mutex mutex;
+    std::deque<double> inFlight; // capture times of events not acked yet
+    double lastAck = 0;
+    bool waiting = false, watching = false;
+    HandEventPtr waitingEvent;
+    double waitingTime = 0;
+    QueueStats counts;
+};
+
+// A client of a stream: the stream's owner or somebody who subscribed to it
+class Subscriber
+{
+  public:
+    // maxRateHz: at most that many events per second, 0 = as many as there
+    // are frames
+    Subscriber(OutboundQueue::Send send, const PublishOptions &opts, float maxRateHz,
+               OutboundQueue::Queued queued = OutboundQueue::Queued(),
+               OutboundQueue::WhenWritten whenWritten = OutboundQueue::WhenWritten())
+      : opts(opts), minInterval(maxRateHz > 0 ? 1.0 / maxRateHz : 0),
+        outbound(std::make_shared<OutboundQueue>(send, opts, queued, whenWritten)) {};
+    void offer(const HandEventPtr&, double time);
+
+    PublishOptions opts;
+    double minInterval;
+    double lastOffered = -1;
+    ChangeFilter changes;
+    std::shared_ptr<OutboundQueue> outbound;
+};
+
+}
+}
+
+#endif  // HAND_DETECTOR_SERVER_HAND_EVENTS_H_
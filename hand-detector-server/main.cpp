@@ -2,6 +2,8 @@
 #include <string>
 #include <chrono>
 #include <thread>
+#include <map>
+#include <memory>
 
 using std::string;
 
@@ -12,20 +14,31 @@ using std::string;
 #include "BoundedBuffer.hpp"
 
 #include "services.hpp"
+#include "unix-socket.hpp"
+
+using namespace handdetection::server;
+
+const std::map<string, Service> services{
+  {"capture-camera", captureCameraService},
+  {"capture-camera-ack", captureCameraAck},
+  {"upload-image", uploadImageService},
+  {"recognize-screen-corners", recognizeScreenCornersService},
+  {"screen-corner-transform", screenCornersTransform},
+  {"screen-transform", screenTransform},
+  {"hand-detection", handDetection},
+  {"hand-detection-stream-start", handDetectionStreamStart},
+  {"hand-detection-stream-stop", handDetectionStreamStop},
+  {"hand-detection-stream-subscribe", handDetectionStreamSubscribe},
+  {"hand-detection-stream-ack", handDetectionStreamAck},
+  {"hand-detection-stream-stats", handDetectionStreamStats}
+};
 
 void startServer(string host, int port, string id)
 {
-
-  auto server = l2l::startServer(host, port, id, l2l::Services {
-    l2l::createLambdaService("capture-camera", handdetection::server::captureCameraService),
-    l2l::createLambdaService("upload-image", handdetection::server::uploadImageService),
-    l2l::createLambdaService("recognize-screen-corners", handdetection::server::recognizeScreenCornersService),
-    l2l::createLambdaService("screen-corner-transform", handdetection::server::screenCornersTransform),
-    l2l::createLambdaService("screen-transform", handdetection::server::screenTransform),
-    l2l::createLambdaService("hand-detection", handdetection::server::handDetection),
-    l2l::createLambdaService("hand-detection-stream-start", handdetection::server::handDetectionStreamStart),
-    l2l::createLambdaService("hand-detection-stream-stop", handdetection::server::handDetectionStreamStop)
-  });
+  l2l::Services l2lServices;
+  for (auto &service : services)
+    l2lServices.push_back(l2l::createLambdaService(service.first, viaL2l(service.second)));
+  auto server = l2l::startServer(host, port, id, l2lServices);
   server->debug = true;
 }
 
@@ -35,8 +48,15 @@ int main(int argc, char** argv)
   int port = 10501;
   std::string host = "0.0.0.0";
   std::string id = "hand-detector-server";
- 
- 
+
+  // --unix-socket path: local clients can skip TCP, see unix-socket.hpp
+  std::unique_ptr<UnixSocketServer> local;
+  for (int i = 1; i + 1 < argc; i++) {
+    if (string(argv[i]) != "--unix-socket") continue;
+    local.reset(new UnixSocketServer(argv[i + 1], id, services, clientGone));
+    local->start();
+  }
+
   startServer(host, port, id);
   // std::thread serverThread(bind(startServer, host, port, id));
   // readFrame();
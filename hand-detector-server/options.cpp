@@ -2,6 +2,7 @@
 #include <string>
 
 #include "vision/hand-detection.hpp"
+#include "vision/hand-tracking.hpp"
 #include "vision/screen-detection.hpp"
 #include "json/json.h"
 
@@ -22,6 +23,13 @@ int thresholdType(std::string name)
   else                                     return CV_THRESH_BINARY;
 }
 
+vision::hand::ProjectionMode projectionMode(std::string name)
+{
+  if      (name == "warp-mask") return vision::hand::ProjectionMode::warpMask;
+  else if (name == "points")    return vision::hand::ProjectionMode::points;
+  else                          return vision::hand::ProjectionMode::warpFrames;
+}
+
 vision::quad::Options quadOptions(Value &data)
 {
   vision::quad::Options opts;
@@ -55,6 +63,10 @@ vision::hand::Options handOptions(Value &data)
   if (data.isMember("debug"))                     opts.debug                     = data["debug"].asBool();
   if (data.isMember("renderDebugImages"))         opts.renderDebugImages         = data["renderDebugImages"].asBool();
   if (data.isMember("fingerTipWidth"))            opts.fingerTipWidth            = data["fingerTipWidth"].asInt();
+  if (data.isMember("fingerTipStep"))             opts.fingerTipStep             = data["fingerTipStep"].asInt();
+  if (data.isMember("fingerTipK"))                opts.fingerTipK                = data["fingerTipK"].asInt();
+  if (data.isMember("fingerTipMaxAngle"))         opts.fingerTipMaxAngle         = data["fingerTipMaxAngle"].asFloat();
+  if (data.isMember("maxFingerTips"))             opts.maxFingerTips             = data["maxFingerTips"].asInt();
   if (data.isMember("minHandAreaInPercent"))      opts.minHandAreaInPercent      = data["minHandAreaInPercent"].asFloat();
   if (data.isMember("depthSamplingKernelLength")) opts.depthSamplingKernelLength = data["depthSamplingKernelLength"].asInt();
   if (data.isMember("blurIntensity"))             opts.blurIntensity             = data["blurIntensity"].asInt();
@@ -63,5 +75,83 @@ vision::hand::Options handOptions(Value &data)
   if (data.isMember("thresholdType"))             opts.thresholdType             = thresholdType(data["thresholdType"].asString());
   if (data.isMember("dilateIterations"))          opts.dilateIterations          = data["dilateIterations"].asInt();
   if (data.isMember("cropWidth"))                 opts.cropWidth                 = data["cropWidth"].asInt();
+  if (data.isMember("projectionMode"))            opts.projectionMode            = projectionMode(data["projectionMode"].asString());
+  if (data.isMember("trackingMargin"))            opts.trackingMargin            = data["trackingMargin"].asInt();
+  if (data.isMember("fullScanInterval"))          opts.fullScanInterval          = data["fullScanInterval"].asInt();
+  if (data.isMember("tileSize"))                  opts.tileSize                  = data["tileSize"].asInt();
+  if (data.isMember("tileChangeTolerance"))       opts.tileChangeTolerance       = data["tileChangeTolerance"].asInt();
+  return opts;
+}
+
+vision::hand::TrackingOptions trackingOptions(Value &data)
+{
+  vision::hand::TrackingOptions opts;
+  if (data.isMember("maxMatchDistance")) opts.maxMatchDistance = data["maxMatchDistance"].asFloat();
+  if (data.isMember("maxMissedFrames"))  opts.maxMissedFrames  = data["maxMissedFrames"].asInt();
+  if (data.isMember("minCutoff"))        opts.minCutoff        = data["minCutoff"].asFloat();
+  if (data.isMember("beta"))             opts.beta             = data["beta"].asFloat();
+  if (data.isMember("derivateCutoff"))   opts.derivateCutoff   = data["derivateCutoff"].asFloat();
+  if (data.isMember("latencyMs"))        opts.latencyMs        = data["latencyMs"].asInt();
+  if (data.isMember("smooth"))           opts.smooth           = data["smooth"].asBool();
+  return opts;
+}
+
+handdetection::server::PublishOptions publishOptions(Value &data)
+{
+  handdetection::server::PublishOptions opts;
+  if (data.isMember("changesOnly"))  opts.changesOnly  = data["changesOnly"].asBool();
+  if (data.isMember("epsilon"))      opts.epsilon      = data["epsilon"].asFloat();
+  if (data.isMember("heartbeatMs"))  opts.heartbeatMs  = data["heartbeatMs"].asInt();
+  if (data.isMember("ackWindow"))    opts.ackWindow    = data["ackWindow"].asInt();
+  if (data.isMember("ackTimeoutMs")) opts.ackTimeoutMs = data["ackTimeoutMs"].asInt();
+  if (data.isMember("maxQueued"))    opts.maxQueued    = data["maxQueued"].asInt();
+  return opts;
+}
+
+vision::hand::HandFields handFields(Value &data)
+{
+  // the names of the fields to send, all of them if there is no list
+  vision::hand::HandFields fields;
+  if (!data.isArray()) return fields;
+  fields.id = fields.palmRadius = fields.palmCenter = fields.contourBounds = fields.fingerTips = false;
+  for (auto &name : data) {
+    auto field = name.asString();
+    if      (field == "id")            fields.id            = true;
+    else if (field == "palmRadius")    fields.palmRadius    = true;
+    else if (field == "palmCenter")    fields.palmCenter    = true;
+    else if (field == "contourBounds") fields.contourBounds = true;
+    else if (field == "fingerTips")    fields.fingerTips    = true;
+  }
+  return fields;
+}
+
+handdetection::server::JpegOptions jpegOptions(Value &data)
+{
+  handdetection::server::JpegOptions opts;
+  if (data.isMember("quality")) opts.quality = data["quality"].asInt();
+  if (data.isMember("gray"))    opts.gray    = data["gray"].asBool();
+  if (data.isMember("scale"))   opts.scale   = data["scale"].asFloat();
+  return opts;
+}
+
+vision::depth::Encoding depthEncoding(std::string name)
+{
+  if      (name == "png") return vision::depth::png;
+  else if (name == "rvl") return vision::depth::rvl;
+  else                    return vision::depth::jpeg;
+}
+
+handdetection::server::RateOptions rateOptions(Value &data)
+{
+  handdetection::server::RateOptions opts;
+  if (data.isMember("adaptive"))        opts.adaptive        = data["adaptive"].asBool();
+  if (data.isMember("targetLatencyMs")) opts.targetLatencyMs = data["targetLatencyMs"].asInt();
+  if (data.isMember("maxKbps"))         opts.maxKbps         = data["maxKbps"].asInt();
+  if (data.isMember("acks"))            opts.acks            = data["acks"].asBool();
+  opts.metadata = data.get("metadata", opts.adaptive).asBool();
+  if (data.isMember("minScale"))        opts.minScale        = data["minScale"].asFloat();
+  if (data.isMember("minQuality"))      opts.minQuality      = data["minQuality"].asInt();
+  if (data.isMember("minIntervalMs"))   opts.minIntervalMs   = data["minIntervalMs"].asInt();
+  if (data.isMember("maxIntervalMs"))   opts.maxIntervalMs   = data["maxIntervalMs"].asInt();
   return opts;
 }
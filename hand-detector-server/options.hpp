@@ -6,12 +6,22 @@
 #include <string>
 
 #include "vision/hand-detection.hpp"
+#include "vision/hand-tracking.hpp"
 #include "vision/screen-detection.hpp"
 #include "json/json.h"
+#include "hand-events.hpp"
+#include "preview-encoder.hpp"
+#include "rate-control.hpp"
 
 vision::quad::Options quadOptions(Json::Value&);
 vision::screen::Options screenOptions(Json::Value&);
 vision::hand::Options handOptions(Json::Value&);
+vision::hand::TrackingOptions trackingOptions(Json::Value&);
+handdetection::server::PublishOptions publishOptions(Json::Value&);
+vision::hand::HandFields handFields(Json::Value&);
+handdetection::server::JpegOptions jpegOptions(Json::Value&);
+vision::depth::Encoding depthEncoding(std::string);
+handdetection::server::RateOptions rateOptions(Json::Value&);
 
 
 #endif  // HAND_DETECTION_SERVER_OPTIONS_H_
\ No newline at end of file
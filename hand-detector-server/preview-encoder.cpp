@@ -0,0 +1,136 @@
+#include "preview-encoder.hpp"
+#include <iostream>
+#include "vision/cv-helper.hpp"
+
+namespace handdetection {
+namespace server {
+
+using cv::Mat;
+using std::vector;
+using Clock = std::chrono::steady_clock;
+
+static double msSince(Clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+PreviewEncoder::PreviewEncoder(int threads, int queued) : jobs(queued)
+{
+  for (int i = 0; i < threads; i++)
+    workers.push_back(std::thread(&PreviewEncoder::work, this));
+}
+
+PreviewEncoder::~PreviewEncoder()
+{
+  for (size_t i = 0; i < workers.size(); i++)
+    jobs.deposit(Job{true, 0, Mat(), JpegOptions(), false, vision::depth::jpeg, Clock::now()});
+  for (auto &worker : workers) worker.join();
+}
+
+void PreviewEncoder::submit(Mat image, const JpegOptions &opts)
+{
+  queue(Job{false, 0, image, opts, false, vision::depth::jpeg, Clock::now()});
+}
+
+void PreviewEncoder::submitDepth(Mat depth, vision::depth::Encoding encoding, const JpegOptions &opts)
+{
+  queue(Job{false, 0, depth, opts, true, encoding, Clock::now()});
+}
+
+void PreviewEncoder::queue(Job job)
+{
+  if (job.image.empty()) return;
+  {
+    std::lock_guard<std::mutex> l(lock);
+    job.seq = submitted++;
+  }
+  jobs.deposit(job);
+}
+
+void PreviewEncoder::deliver(Send send, bool wait)
+{
+  std::unique_lock<std::mutex> l(lock);
+  while (delivered < submitted)
+  {
+    auto next = done.find(delivered);
+    if (next == done.end()) {
+      if (!wait) return;
+      encoded.wait(l);
+      continue;
+    }
+    Encoded image;
+    std::swap(image, next->second);
+    done.erase(next);
+    delivered++;
+
+    // encoding failed when empty
+    l.unlock();
+    if (!image.data.empty()) send(image.data, image.encodeMs, msSince(image.submitted));
+    l.lock();
+    spare.push_back(std::move(image.data));
+  }
+}
+
+void PreviewEncoder::work()
+{
+  vector<int> params(2);
+  while (true)
+  {
+    Job job = jobs.fetch();
+    if (job.stop) return;
+
+    vector<uchar> buffer;
+    {
+      std::lock_guard<std::mutex> l(lock);
+      if (!spare.empty()) { buffer.swap(spare.back()); spare.pop_back(); }
+    }
+    auto start = Clock::now();
+    try {
+      encode(job, params, buffer);
+    } catch (const std::exception& e) {
+      std::cout << "error encoding jpeg: " << e.what() << std::endl;
+      buffer.clear();
+    }
+    double encodeMs = msSince(start);
+
+    {
+      std::lock_guard<std::mutex> l(lock);
+      Encoded &image = done[job.seq];
+      image.data.swap(buffer);
+      image.encodeMs = encodeMs;
+      image.submitted = job.submitted;
+    }
+    encoded.notify_all();
+  }
+}
+
+void PreviewEncoder::encode(Job &job, vector<int> &params, vector<uchar> &out)
+{
+  Mat &image = job.image;
+  const JpegOptions &opts = job.opts;
+  bool lossless = job.depth && job.depthEncoding != vision::depth::jpeg;
+  int interpolation = lossless ? cv::INTER_NEAREST : cv::INTER_AREA;
+  if (opts.scale > 0 && opts.scale < 1)
+    cv::resize(image, image, cv::Size(), opts.scale, opts.scale, interpolation);
+  if (opts.maxWidth > 0 && opts.maxHeight > 0) {
+    cv::Size fitted = cvhelper::sizeToFit(image.size(), opts.maxWidth, opts.maxHeight);
+    if (fitted != image.size()) cv::resize(image, image, fitted, 0, 0, interpolation);
+  }
+
+  if (job.depth) {
+    if (lossless) { vision::depth::encode(image, job.depthEncoding, out); return; }
+    // JPEG is 8 bit, everything beyond 255mm saturates
+    image.convertTo(image, CV_8U);
+  }
+  if (opts.gray && image.channels() > 1)
+    cv::cvtColor(image, image, image.channels() == 4 ? CV_BGRA2GRAY : CV_BGR2GRAY);
+
+  params[0] = CV_IMWRITE_JPEG_QUALITY;
+  params[1] = opts.quality;
+  // out keeps the capacity of earlier images, imencode does not have to
+  // grow it again
+  cv::imencode(".jpg", image, out, params);
+}
+
+}
+}
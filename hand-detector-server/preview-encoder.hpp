@@ -0,0 +1,95 @@
+#ifndef HAND_DETECTOR_SERVER_PREVIEW_ENCODER_H_
+#define HAND_DETECTOR_SERVER_PREVIEW_ENCODER_H_
+
+/*
+Encoding of preview images off the service thread: JPEG for color, JPEG or
+one of the lossless encodings of vision/depth-codec.hpp for depth. Images
+are queued with submit and encoded by worker threads while the caller goes
+on reading the camera. deliver hands the encoded images back in the order
+they were submitted, so that e.g. color and depth of a frame still arrive
+in pairs, and keeps the buffers to encode into again.
+*/
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+#include "vision/depth-codec.hpp"
+#include "BoundedBuffer.hpp"
+
+namespace handdetection {
+namespace server {
+
+struct JpegOptions
+{
+  int quality = 75;
+  // OpenCV's encoder always subsamples chroma (4:2:0), gray drops it
+  // altogether: a third less to encode and send
+  bool gray = false;
+  float scale = 1;                  // downscale before encoding
+  int maxWidth = 0, maxHeight = 0;  // fit into, if given
+};
+
+class PreviewEncoder
+{
+  public:
+    // the encoded image, how long encoding it took and how long it was in
+    // the encoder altogether, since submit
+    typedef std::function<void(const std::vector<uchar>&, double encodeMs, double queuedMs)> Send;
+
+    // queued: how many images can wait for a worker before submit blocks
+    PreviewEncoder(int threads = 2, int queued = 4);
+    ~PreviewEncoder();
+
+    // Takes image over: whoever submits it must not write into it anymore,
+    // e.g. let the camera allocate a new frame. Empty images are skipped.
+    void submit(cv::Mat image, const JpegOptions &opts);
+    // the same for depth (millimetres) as encoding. The lossless encodings
+    // are scaled by dropping pixels, to keep the measurements as they are
+    void submitDepth(cv::Mat depth, vision::depth::Encoding encoding, const JpegOptions &opts);
+    // Calls send with the images encoded so far, in order. wait: until all
+    // submitted images are encoded and sent.
+    void deliver(Send send, bool wait = false);
+
+  private:
+    struct Job
+    {
+      bool stop;
+      uint64_t seq;
+      cv::Mat image;
+      JpegOptions opts;
+      bool depth;
+      vision::depth::Encoding depthEncoding;
+      std::chrono::steady_clock::time_point submitted;
+    };
+
+    struct Encoded
+    {
+      std::vector<uchar> data;
+      double encodeMs;
+      std::chrono::steady_clock::time_point submitted;
+    };
+
+    void queue(Job job);
+    void work();
+    static void encode(Job &job, std::vector<int> &params, std::vector<uchar> &out);
+
+    BoundedBuffer<Job> jobs;
+    std::vector<std::thread> workers;
+
+    std::mutex lock;
+    std::condition_variable encoded;
+    uint64_t submitted = 0, delivered = 0;
+    std::map<uint64_t, Encoded> done;            // by seq
+    std::vector<std::vector<uchar>> spare;       // buffers to encode into
+};
+
+}
+}
+
+#endif  // HAND_DETECTOR_SERVER_PREVIEW_ENCODER_H_
@@ -0,0 +1,119 @@
+#include "rate-control.hpp"
+#include <algorithm>
+
+namespace handdetection {
+namespace server {
+
+// after a change, wait that many frames and until the bandwidth window
+// only has images with the new parameters
+const int holdFrames = 5;
+const double windowSeconds = 0.5;
+
+static void smooth(double &value, double sample)
+{
+  value = value == 0 ? sample : value * 0.8 + sample * 0.2;
+}
+
+RateController::RateController(const JpegOptions &requested, const RateOptions &opts)
+  : requested(requested), opts(opts),
+    quality(requested.quality), interval(opts.minIntervalMs) {}
+
+void RateController::sent(size_t size, double encodeMs, double queuedMs, double time)
+{
+  smooth(current.encodeMs, encodeMs);
+  unconfirmed.push_back(time - queuedMs / 1000);
+
+  bytes.push_back(std::make_pair(time, size));
+  bytesInWindow += size;
+  while (bytes.front().first < time - windowSeconds) {
+    bytesInWindow -= bytes.front().second;
+    bytes.pop_front();
+  }
+  current.kbps = bytesInWindow * 8 / 1000.0 / windowSeconds;
+}
+
+void RateController::written(double time)
+{
+  // with acks, arriving is what counts
+  if (!opts.acks) confirm(1, time);
+}
+
+void RateController::ack(int count, double time)
+{
+  if (opts.acks) confirm(count, time);
+}
+
+void RateController::confirm(int count, double time)
+{
+  for (; count > 0 && !unconfirmed.empty(); count--) {
+    smooth(current.latencyMs, (time - unconfirmed.front()) * 1000);
+    unconfirmed.pop_front();
+  }
+}
+
+bool RateController::adjust(double time)
+{
+  if (!opts.adaptive || ++framesSinceChange < holdFrames || time - lastChange < windowSeconds) return false;
+
+  // a client that stopped acking or reading is as late as its oldest image
+  double latencyMs = current.latencyMs;
+  if (!unconfirmed.empty()) latencyMs = std::max(latencyMs, (time - unconfirmed.front()) * 1000);
+
+  bool over = latencyMs > opts.targetLatencyMs || (opts.maxKbps > 0 && current.kbps > opts.maxKbps),
+       under = latencyMs < opts.targetLatencyMs / 2 && (opts.maxKbps <= 0 || current.kbps < opts.maxKbps * 0.7);
+  bool changed = over ? degrade() : under ? improve() : false;
+  if (changed) { framesSinceChange = 0; lastChange = time; }
+  return changed;
+}
+
+bool RateController::degrade()
+{
+  bool encodeBound = current.encodeMs > opts.targetLatencyMs / 2;
+  if (!encodeBound && quality > opts.minQuality) {
+    quality = std::max(opts.minQuality, quality - 10);
+    return true;
+  }
+  if (scale > opts.minScale) {
+    scale = std::max(opts.minScale, scale * 0.8f);
+    return true;
+  }
+  if (quality > opts.minQuality) {
+    quality = std::max(opts.minQuality, quality - 10);
+    return true;
+  }
+  if (interval < opts.maxIntervalMs) {
+    interval = std::min(opts.maxIntervalMs, interval * 3 / 2 + 1);
+    return true;
+  }
+  return false;
+}
+
+bool RateController::improve()
+{
+  if (interval > opts.minIntervalMs) {
+    interval = std::max(opts.minIntervalMs, interval * 4 / 5);
+    return true;
+  }
+  if (scale < 1) {
+    // smaller steps up than down, one step must not cross the margin
+    // between improving and degrading
+    scale = std::min(1.0f, scale * 1.1f);
+    return true;
+  }
+  if (quality < requested.quality) {
+    quality = std::min(requested.quality, quality + 5);
+    return true;
+  }
+  return false;
+}
+
+JpegOptions RateController::jpeg() const
+{
+  JpegOptions jpeg = requested;
+  jpeg.scale = requested.scale * scale;
+  jpeg.quality = quality;
+  return jpeg;
+}
+
+}
+}
@@ -0,0 +1,87 @@
+#ifndef HAND_DETECTOR_SERVER_RATE_CONTROL_H_
+#define HAND_DETECTOR_SERVER_RATE_CONTROL_H_
+
+/*
+Adapts a capture-camera stream to what the client and the link take. The
+controller watches how long images take from capture until they are
+written to the client's socket (or, if the client acks them, until they
+arrived), how long encoding takes and how many bytes go out per second.
+Only the Unix socket tells when a write completes. l2l does not, there
+"written" is when the image was handed to it, so without acks the latency
+of an l2l client covers capture and encoding but not the link. Clients on
+l2l that need the link in it ack. When latency or bandwidth are over
+their targets it degrades one step: JPEG quality first, then the downscale
+factor, then the frame interval. If encoding is what takes long, scale
+goes first, quality hardly changes encoding time. With room to spare it
+steps back the same way up to what the client asked for. After a change it
+waits a few frames to see its effect.
+*/
+
+#include <deque>
+#include <utility>
+#include "preview-encoder.hpp"
+
+namespace handdetection {
+namespace server {
+
+struct RateOptions
+{
+  bool adaptive = false;       // false: parameters stay as requested
+  int targetLatencyMs = 150;   // capture to written, or to acked with acks
+  int maxKbps = 0;             // 0: no bandwidth limit
+  bool acks = false;           // the client acks images, capture-camera-ack
+  bool metadata = false;       // capture-camera-metadata messages, on with adaptive
+  float minScale = 0.25f;
+  int minQuality = 30;
+  int minIntervalMs = 10;
+  int maxIntervalMs = 1000;
+};
+
+struct RateStats
+{
+  double latencyMs = 0, encodeMs = 0; // smoothed
+  double kbps = 0;                    // over the last half second
+};
+
+class RateController
+{
+  public:
+    RateController(const JpegOptions &requested, const RateOptions &opts);
+
+    // An image went out. queuedMs: from submitting it to the encoder until
+    // now, encodeMs of that. time: seconds, now
+    void sent(size_t size, double encodeMs, double queuedMs, double time);
+    // the oldest image sent is written to the socket
+    void written(double time);
+    // the client got count more images
+    void ack(int count, double time);
+    // Once per frame, before capturing it. True if the parameters changed.
+    bool adjust(double time);
+
+    JpegOptions jpeg() const;
+    int intervalMs() const { return interval; };
+    bool reportsMetadata() const { return opts.metadata; };
+    RateStats stats() const { return current; };
+
+  private:
+    bool degrade();
+    bool improve();
+    void confirm(int count, double time);
+
+    JpegOptions requested;
+    RateOptions opts;
+    float scale = 1;
+    int quality, interval;
+    int framesSinceChange = 0;
+    double lastChange = 0;
+
+    RateStats current;
+    std::deque<double> unconfirmed;              // not written (acked) yet, when submitted
+    std::deque<std::pair<double, size_t>> bytes; // (time, bytes), see kbps
+    size_t bytesInWindow = 0;
+};
+
+}
+}
+
+#endif  // HAND_DETECTOR_SERVER_RATE_CONTROL_H_
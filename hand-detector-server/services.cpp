@@ -4,16 +4,23 @@
 #include <string>
 #include <strstream>
 #include <ctime>
+#include <atomic>
 
 #include "json/json.h"
 
 #include "vision/hand-detection.hpp"
+#include "vision/hand-tracking.hpp"
 #include "vision/screen-detection.hpp"
 #include "vision/cv-debugging.hpp"
 #include "vision/cv-helper.hpp"
+#include "vision/warp-maps.hpp"
 #include "camera.hpp"
+#include "hand-events.hpp"
+#include "preview-encoder.hpp"
+#include "rate-control.hpp"
 #include "options.hpp"
 #include "services.hpp"
+#include "shm-ring.hpp"
 #include "timer.hpp"
 
 using std::string;
@@ -25,20 +32,46 @@ using Json::Value;
 namespace handdetection {
 namespace server {
 
-bool debug = false;
+std::atomic<bool> debug(false); // services set it, from either listener's thread
 #define dbg \
     if (!debug) {} \
     else std::cout
 
 
+void readCalibration(vision::cam::CameraPtr dev, string calibrationFile)
+{
+  // expects the output of OpenCV's camera calibration sample
+  std::cout << "Reading calibration file: " << calibrationFile << std::endl;
+  Mat cameraMatrix, distCoeffs;
+  int width = 0, height = 0;
+  cv::FileStorage fs(calibrationFile, cv::FileStorage::READ);
+  fs["camera_matrix"] >> cameraMatrix;
+  fs["distortion_coefficients"] >> distCoeffs;
+  fs["image_width"] >> width;
+  fs["image_height"] >> height;
+  if (!cameraMatrix.empty())
+    dev->setLensModel(cameraMatrix, distCoeffs, cv::Size(width, height));
+}
+
 vision::cam::CameraPtr getVideoCaptureDev(Value &msg)
 {
   std::string videoDevName = msg["data"].get("deviceNo", "").asString();
+  vision::cam::CameraPtr dev;
   try {
-    return vision::cam::getCamera(std::stoi(videoDevName));
+    dev = vision::cam::getCamera(std::stoi(videoDevName));
   } catch(const std::exception& e) {
-    return vision::cam::getCamera(videoDevName);
+    dev = vision::cam::getCamera(videoDevName);
   }
+  auto calibrationFile = msg["data"].get("calibrationFile", "").asString();
+  if (calibrationFile != "") readCalibration(dev, calibrationFile);
+  return dev;
+}
+
+vision::warp::Lens lensOf(vision::cam::CameraPtr dev)
+{
+  vision::warp::Lens lens;
+  dev->lensModel(lens.cameraMatrix, lens.distCoeffs, lens.imageSize);
+  return lens;
 }
 
 
@@ -53,11 +86,9 @@ void answerWithError(Server &server, Value &msg, string errMessage)
 
 bool uploadedDataToMat(Server &server, string &sender, Value &msg, Mat &image)
 {
-  auto uploaded = server->getUploadedBinaryDataOf(sender);
-  server->clearUploadedBinaryDataOf(sender);
-  if (uploaded.empty()) { image = Mat(); return false; }
+  vector<uchar> data;
+  if (!server->takeUploadedBinaryData(sender, data)) { image = Mat(); return false; }
 
-  vector<uchar> data(uploaded[0]->data, uploaded[0]->data + uploaded[0]->size);
   image = cv::imdecode(data, CV_LOAD_IMAGE_COLOR);
   return true;
 }
@@ -92,38 +123,112 @@ bool uploadedOrCapturedImage(
 
 void sendMat(Mat &mat, Server &server, string &target)
 {
-  auto params = vector<int>(2);
-  params[0] = CV_IMWRITE_JPEG_QUALITY;
-  params[1] = 75;
-  vector<uchar> buffer;
+  // sendBinary copies, the buffer can be reused
+  static thread_local vector<uchar> buffer;
+  static const vector<int> params{CV_IMWRITE_JPEG_QUALITY, 75};
   imencode(".jpg", mat, buffer, params);
   server->sendBinary(target, &buffer[0], buffer.size());
 }
 
+const auto serverStart = std::chrono::steady_clock::now();
+
+double secondsSince(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// capture-camera streams by client and data.stream, for acks
+typedef std::pair<string, string> CaptureStream;
+std::map<CaptureStream, std::shared_ptr<RateController>> captureStreams;
+
+void sendCaptureMetadata(RateController &rate, uint frames, Server &server, string &target, string &stream)
+{
+  // what the stream runs with now, sent whenever that changes. latencyMs
+  // is to the write, over l2l only to the hand-over, see rate-control.hpp
+  JpegOptions jpeg = rate.jpeg();
+  RateStats stats = rate.stats();
+  Value metadata;
+  metadata["action"] = "capture-camera-metadata";
+  metadata["target"] = target;
+  metadata["data"]["stream"] = stream;
+  metadata["data"]["frames"] = frames;
+  metadata["data"]["scale"] = jpeg.scale;
+  metadata["data"]["quality"] = jpeg.quality;
+  metadata["data"]["intervalMs"] = rate.intervalMs();
+  metadata["data"]["latencyMs"] = stats.latencyMs;
+  metadata["data"]["encodeMs"] = stats.encodeMs;
+  metadata["data"]["kbps"] = stats.kbps;
+  server->send(metadata);
+}
+
 void readFrameAndSend(
   uint &repeat,
-  uint &maxWidth,
-  uint &maxHeight,
+  uint &frames,
   vision::cam::CameraPtr dev,
-  Mat &frame,
-  Mat &depthFrame,
+  std::shared_ptr<PreviewEncoder> &encoder,
+  std::shared_ptr<RateController> &rate,
+  vision::depth::Encoding &depthEncoding,
+  string &depthFile,
   Server &server,
-  string &target)
+  string &target,
+  string &stream)
 {
-  if (repeat == 0) return;
+  // runs without the lock held, encoding can take a while
+  auto send = [&](const vector<uchar> &encoded, double encodeMs, double queuedMs) {
+    {
+      std::lock_guard<std::recursive_mutex> l(serviceLock());
+      rate->sent(encoded.size(), encodeMs, queuedMs, secondsSince(serverStart));
+    }
+    auto written = rate;
+    server->sendBinary(target, &encoded[0], encoded.size(), [written]() {
+      std::lock_guard<std::recursive_mutex> l(serviceLock());
+      written->written(secondsSince(serverStart));
+    });
+  };
+  // what the encoder still has goes out, acks for the stream are ignored
+  auto finish = [&]() {
+    encoder->deliver(send, true);
+    std::lock_guard<std::recursive_mutex> l(serviceLock());
+    auto found = captureStreams.find(CaptureStream(target, stream));
+    if (found != captureStreams.end() && found->second == rate) captureStreams.erase(found);
+  };
+  if (repeat == 0) {
+    finish();
+    return;
+  }
 
+  // rate is shared with captureCameraAck, the camera and the encoder are not
+  std::unique_lock<std::recursive_mutex> l(serviceLock(), std::defer_lock);
   try {
+    // metadata only for clients that asked for it, see RateOptions
+    l.lock();
+    bool changed = rate->adjust(secondsSince(serverStart));
+    if ((changed || frames == 0) && rate->reportsMetadata())
+      sendCaptureMetadata(*rate, frames, server, target, stream);
+    l.unlock();
+
+    // the encoder takes the frames over, the camera fills new ones
+    Mat frame, depthFrame;
     dev->readWithDepth(frame, depthFrame);
-    // resize(frame, frame, cv::Size(), 0.3, 0.3);
-    if (maxWidth > 0 && maxHeight > 0)
-      cvhelper::resizeToFit(frame, frame, maxWidth, maxHeight);
-    sendMat(frame, server, target);
-    if (maxWidth > 0 && maxHeight > 0)
-      cvhelper::resizeToFit(depthFrame, depthFrame, maxWidth, maxHeight);
-    sendMat(depthFrame, server, target);
-    server->setTimer(10, bind(readFrameAndSend, repeat - 1, maxWidth, maxHeight, dev, frame, depthFrame, server, target));
+    if (depthFile != "") {
+      cv::FileStorage fs(depthFile, cv::FileStorage::WRITE);
+      fs << "depth" << depthFrame;
+      fs.release();
+    }
+    JpegOptions jpeg = rate->jpeg();
+    encoder->submit(frame, jpeg);
+    encoder->submitDepth(depthFrame, depthEncoding, jpeg);
+    // what got encoded while we waited for the camera
+    encoder->deliver(send);
+    l.lock();
+    int intervalMs = rate->intervalMs();
+    l.unlock();
+    server->setTimer(intervalMs, bind(readFrameAndSend,
+      repeat - 1, frames + 1, dev, encoder, rate, depthEncoding, string(), server, target, stream));
   } catch (const std::exception& e) {
     std::cout << "error in readFrameAndSend: " << e.what() << std::endl;
+    if (l.owns_lock()) l.unlock();
+    finish();
   }
 }
 
@@ -193,74 +298,188 @@ void depthDiff(
   const Mat &depth,
   const Mat &depthBackground,
   Mat &diffSmooth,
-  Mat &diffMask)
+  Mat &diffMask,
+  const vision::hand::Options &opts,
+  const vision::warp::Maps &toTable = vision::warp::Maps(),
+  const Mat &tableWeights = Mat())
 {
+  // toTable: if given, depth and depthBackground are still in camera space.
+  // We threshold there and only warp the 8 bit results into table space.
+  // tableWeights: camera space without warping anything (point space), for
+  // the norm, see below
 
-  Mat diff(depth.size(), CV_32F);
+  Mat diff;
   absdiff(depth, depthBackground, diff);
   
-  // min, max: between what values should depth be considered?
-  // float depthPercentile = msg["data"].get("depthPercentile", 0.1f).asFloat();
-  // auto minMax = minMaxBasedOnPercentile(diff, depthPercentile);
-  // float min = minMax.first,
-  //       max = minMax.second;
-  float min = msg["data"].get("depthSmoothLowerLimit", 500.0f).asFloat(),
-        max = msg["data"].get("depthSmoothUpperLimit", 1000.0f).asFloat();
-
-  // diff.convertTo(diffSmooth, CV_8U, 255.0f/(max-min), -255.0f*min/(max-min));
-  diff.convertTo(diffSmooth, CV_8U, 255.0f/(max-min));
-  cvtColor(diffSmooth, diffSmooth, CV_GRAY2BGRA);
-
-  cv::normalize(diff, diff);
+  if (opts.renderDebugImages) {
+    // min, max: between what values should depth be considered?
+    // float depthPercentile = msg["data"].get("depthPercentile", 0.1f).asFloat();
+    // auto minMax = minMaxBasedOnPercentile(diff, depthPercentile);
+    // float min = minMax.first,
+    //       max = minMax.second;
+    float min = msg["data"].get("depthSmoothLowerLimit", 500.0f).asFloat(),
+          max = msg["data"].get("depthSmoothUpperLimit", 1000.0f).asFloat();
+
+    // diff.convertTo(diffSmooth, CV_8U, 255.0f/(max-min), -255.0f*min/(max-min));
+    diff.convertTo(diffSmooth, CV_8U, 255.0f/(max-min));
+    if (!toTable.empty()) vision::warp::apply(diffSmooth, diffSmooth, toTable);
+    cvtColor(diffSmooth, diffSmooth, CV_GRAY2BGRA);
+  }
+
+  // same as thresholding the L2-normalized diff with depthThreshold, without
+  // the extra float passes. In camera space the norm has to be the one of the
+  // table space diff, or the same depthThreshold selects a different mask
   auto depthThreshold = msg["data"].get("depthThreshold", 0).asFloat();
-  cv::threshold(diff, diff, depthThreshold, 1.0f, cv::THRESH_BINARY);
-  diff.convertTo(diffMask, CV_8UC1, 255);
+  const Mat &weights = tableWeights.empty() ? toTable.weights : tableWeights;
+  double norm = weights.empty() ? cv::norm(diff, cv::NORM_L2) : vision::warp::warpedNorm(diff, weights);
+  double limit = depthThreshold * norm;
+  Mat mask;
+  cv::compare(diff, limit, mask, cv::CMP_GT);
+  if (toTable.empty()) diffMask = mask;
+  else vision::warp::apply(mask, diffMask, toTable, cv::INTER_NEAREST);
 
   // imshow("diff", diffSmooth);
   // imshow("diff2", diffMask);
   // cv::waitKey(30);
 }
 
-void transformFrame(Mat &input, Mat &output, cv::Size &tfmedSize, Mat &proj)
+cv::Size fittedSize(cv::Size size, int maxWidth, int maxHeight)
+{
+  if (maxWidth > 0 && maxHeight > 0)
+    return cvhelper::sizeToFit(size, maxWidth, maxHeight);
+  return size;
+}
+
+vision::warp::Maps frameMaps(
+  Mat &input,
+  cv::Size scaledSize, cv::Size &tfmedSize,
+  Mat &proj, const vision::warp::Lens &lens)
+{
+  // proj is defined for frames of scaledSize. Instead of resizing input first
+  // we let the scale be part of the projection and resample only once
+  Mat scaledProj = vision::warp::scaledProjection(proj, input.size(), scaledSize);
+  return vision::warp::cachedPerspectiveMaps(scaledProj, input.size(), tfmedSize, lens);
+}
+
+void transformFrame(
+  Mat &input, Mat &output,
+  cv::Size scaledSize, cv::Size &tfmedSize,
+  Mat &proj, const vision::warp::Lens &lens)
+{
+  vision::warp::apply(input, output, frameMaps(input, scaledSize, tfmedSize, proj, lens));
+}
+
+void prepareDepthBackground(
+  Mat &depthBackground, Mat &preparedDepthBackground,
+  cv::Size depthInputSize, cv::Size depthSize, cv::Size tfmedSize,
+  Mat &proj, const vision::warp::Lens &lens,
+  bool cameraSpace)
+{
+  // the background does not change while we are streaming, so this is done
+  // once and the result is reused for every frame. Depending on the
+  // projection mode it ends up in table or in camera space.
+  if (depthBackground.empty()) {
+    preparedDepthBackground = Mat::zeros(cameraSpace ? depthInputSize : tfmedSize, CV_16U);
+    return;
+  }
+  Mat bg;
+  cvhelper::depthToMillimeters(depthBackground, bg);
+  if (cameraSpace) {
+    preparedDepthBackground = bg;
+    if (bg.size() != depthInputSize)
+      resize(bg, preparedDepthBackground, depthInputSize);
+  } else {
+    transformFrame(bg, preparedDepthBackground, depthSize, tfmedSize, proj, lens);
+  }
+}
+
+bool detectsInCameraSpace(const Mat &in, const Mat &depth, const vision::hand::Options &opts)
 {
-  output.create(tfmedSize, input.type());
-  cv::warpPerspective(input, output, proj, tfmedSize);
+  // Detecting in camera space needs color and depth to be registered
+  return !depth.empty() && opts.projectionMode == vision::hand::ProjectionMode::points
+      && depth.size() == in.size();
 }
 
 void recognizeHand(
   Value &msg,
-  Mat &in, Mat &depth, Mat &depthBackground, Mat &proj, Mat &out,
+  Mat &in, Mat &depth, Mat &depthBackground, Mat &preparedDepthBackground,
+  Mat &proj, const vision::warp::Lens &lens,
+  vision::hand::HandDetector &detector, Mat &out,
   vision::hand::FrameWithHands &handData,
   int maxWidth, int maxHeight,
   vision::hand::Options &opts,
   bool record = false)
 {
-  if (maxWidth > 0 && maxHeight > 0) {
-    cvhelper::resizeToFit(in, in, maxWidth, maxHeight);
-    if (!depth.empty()) cvhelper::resizeToFit(depth, depth, maxWidth, maxHeight);
-    if (!depthBackground.empty()) cvhelper::resizeToFit(depthBackground, depthBackground, maxWidth, maxHeight);
-  }
+  // preparedDepthBackground: depthBackground already brought into the space
+  // the depth diff happens in. Pass an empty Mat and it gets computed (and can
+  // be kept around for the next frame). Same for the detector, it keeps track
+  // of where hands were.
+  // proj was made for frames scaled to fit into maxWidth/maxHeight. That
+  // scaling is done by the projection itself, see frameMaps
+  // Depth is carried as 16 bit millimetres, recordings might still be float.
+  cvhelper::depthToMillimeters(depth, depth);
+  cv::Size tfmedSize = fittedSize(in.size(), maxWidth, maxHeight),
+           depthSize = depth.empty() ? tfmedSize : fittedSize(depth.size(), maxWidth, maxHeight);
+
   if (record) {
-    saveHandInput("", in, depth, depthBackground, proj);
+    // recordings keep the frames in the size proj expects
+    Mat rgb = in, depthRec = depth, depthBg = depthBackground;
+    if (maxWidth > 0 && maxHeight > 0) {
+      cvhelper::resizeToFit(in, rgb, maxWidth, maxHeight);
+      if (!depth.empty()) cvhelper::resizeToFit(depth, depthRec, maxWidth, maxHeight);
+      if (!depthBackground.empty()) cvhelper::resizeToFit(depthBackground, depthBg, maxWidth, maxHeight);
+    }
+    saveHandInput("", rgb, depthRec, depthBg, proj);
   }
 
-  cv::Size tfmedSize = in.size();
-  transformFrame(in, in, tfmedSize, proj);
-  if (depth.empty()) depth = Mat::zeros(in.size(), CV_32F);
-  transformFrame(depth, depth, tfmedSize, proj);
-  if (depthBackground.empty()) depthBackground = Mat::zeros(in.size(), CV_32F);
-  if (depth.size() != depthBackground.size())
-    resize(depthBackground, depthBackground, depth.size());
-  transformFrame(depthBackground, depthBackground, tfmedSize, proj);
-
-  Mat diffSmooth(depth.size(), CV_8UC4);
-  Mat diffMask(depth.size(), CV_8UC1);
-
-  depthDiff(msg, depth, depthBackground, diffSmooth, diffMask);
-
-  vision::hand::processFrame(
-    in, depth, depthBackground, diffSmooth, diffMask,
-    handData, opts);
+  // without depth there is nothing to project, we diff zeros in table space
+  bool hasDepth = !depth.empty(),
+       warpMask = hasDepth && opts.projectionMode == vision::hand::ProjectionMode::warpMask,
+       pointSpace = detectsInCameraSpace(in, depth, opts);
+
+  if (preparedDepthBackground.empty())
+    prepareDepthBackground(
+      depthBackground, preparedDepthBackground,
+      hasDepth ? depth.size() : tfmedSize, depthSize, tfmedSize,
+      proj, lens, warpMask || pointSpace);
+
+  if (!pointSpace) transformFrame(in, in, tfmedSize, tfmedSize, proj, lens);
+
+  Mat diffSmooth, diffMask;
+
+  if (pointSpace) {
+    // no frame gets projected, only the hand data processFrame finds. We
+    // only look at the part of the frames that shows the table. The area
+    // weights give the depth threshold its table space norm
+    Mat scaledProj = vision::warp::scaledProjection(proj, depth.size(), depthSize);
+    cv::Rect roi = vision::warp::cachedInputRoi(scaledProj, depth.size(), tfmedSize, lens);
+    Mat weights = vision::warp::cachedAreaWeights(scaledProj, depth.size(), tfmedSize, lens);
+    auto outline = vision::warp::outline(scaledProj, depth.size(), tfmedSize, lens);
+    for (auto &p : outline) p -= roi.tl();
+    vision::hand::TableSpace table{
+      outline, scaledProj, lens, tfmedSize, roi.tl(), depth.size()};
+    Mat inRoi(in, roi), depthRoi(depth, roi), bgRoi(preparedDepthBackground, roi);
+    depthDiff(msg, depthRoi, bgRoi, diffSmooth, diffMask, opts, vision::warp::Maps(), weights);
+    detector.processFrame(
+      inRoi, depthRoi, bgRoi, diffSmooth, diffMask,
+      handData, opts, Mat(), table);
+  } else if (warpMask) {
+    // depth stays in camera space, processFrame uses the nearest neighbor
+    // lookup of the maps to sample it. Both are cropped to the table.
+    auto depthMaps = frameMaps(depth, depthSize, tfmedSize, proj, lens);
+    Mat depthRoi(depth, depthMaps.roi), bgRoi(preparedDepthBackground, depthMaps.roi);
+    depthDiff(msg, depthRoi, bgRoi, diffSmooth, diffMask, opts, depthMaps);
+    detector.processFrame(
+      in, depthRoi, bgRoi, diffSmooth, diffMask,
+      handData, opts, depthMaps.xyNearest);
+  } else {
+    if (hasDepth) transformFrame(depth, depth, depthSize, tfmedSize, proj, lens);
+    else depth = Mat::zeros(tfmedSize, CV_16U);
+    depthDiff(msg, depth, preparedDepthBackground, diffSmooth, diffMask, opts);
+    detector.processFrame(
+      in, depth, preparedDepthBackground, diffSmooth, diffMask,
+      handData, opts);
+  }
 
   // debugging...
   if (opts.renderDebugImages) {
@@ -274,43 +493,163 @@ void recognizeHand(
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
 std::map<std::string, bool> handDetectionActivities;
+// the clients a stream publishes to, by the id of the client that started
+// it. That one comes first, others join with hand-detection-stream-subscribe
+std::map<std::string, vector<std::shared_ptr<Subscriber>>> streamSubscribers;
+// the same by client and stream, for acks and stats. A client can be
+// subscribed to any number of streams.
+typedef std::pair<string, string> Subscription;
+std::map<Subscription, std::shared_ptr<Subscriber>> subscribers;
+
+void publishHandEvent(
+  string &target, Server &server, Value &msg,
+  HandEvent &event, const vision::hand::HandFields &fields, bool binary)
+{
+  // the encoding is chosen by the client when subscribing: "json" (default)
+  // or "binary", see frameWithHandsToBinary. Binary records have all fields,
+  // see subscribable.
+  if (binary) {
+    vector<uchar> &encoded = event.binary();
+    server->sendBinary(target, &encoded[0], encoded.size());
+    return;
+  }
+
+  Value handEventMsg;
+  handEventMsg["action"] = "hand-event";
+  handEventMsg["target"] = msg["sender"];
+
+  // the frame's JSON is written once per selection and goes into both
+  // messages. l2l only takes Json::Values, it gets those.
+  if (server->writesJSON()) {
+    const string &data = event.jsonText(fields);
+    server->answerJSON(msg, data, true);
+    server->sendJSON(handEventMsg, data);
+    return;
+  }
+
+  const Value &data = event.json(fields);
+  server->answer(msg, data, true);
+  handEventMsg["data"] = data;
+  server->send(handEventMsg);
+}
+
+bool subscribable(Server &server, Value &msg)
+{
+  // binary records have a fixed layout, a field selection would be ignored
+  bool binary = msg["data"].get("encoding", "json").asString() == "binary";
+  if (binary && msg["data"].isMember("fields")) {
+    answerWithError(server, msg, "binary hand events have all fields, no data.fields");
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<Subscriber> subscriberFor(string sender, Server server, Value msg)
+{
+  Value publishing = msg["data"].get("publish", Value(Json::objectValue)),
+        fieldNames = msg["data"].get("fields", Value());
+  auto fields = handFields(fieldNames);
+  bool binary = msg["data"].get("encoding", "json").asString() == "binary";
+  float maxRateHz = msg["data"].get("maxRateHz", 0).asFloat();
+  return std::make_shared<Subscriber>(
+    [=](HandEvent &event) mutable {
+      publishHandEvent(sender, server, msg, event, fields, binary); },
+    publishOptions(publishing), maxRateHz,
+    [=]() { return server->queuedFor(sender); },
+    [=](std::function<void()> fn) { server->whenWritten(sender, fn); });
+}
+
+void unsubscribe(const Subscription &subscription)
+{
+  auto found = subscribers.find(subscription);
+  if (found == subscribers.end()) return;
+  auto stream = streamSubscribers.find(subscription.second);
+  if (stream != streamSubscribers.end()) {
+    auto &list = stream->second;
+    list.erase(std::remove(list.begin(), list.end(), found->second), list.end());
+  }
+  subscribers.erase(found);
+}
+
+void stopHandDetectionStream(const string &stream)
+{
+  handDetectionActivities[stream] = false;
+
+  // the stream's subscribers go with it
+  for (auto it = subscribers.begin(); it != subscribers.end(); )
+    it = it->first.second == stream ? subscribers.erase(it) : std::next(it);
+  streamSubscribers.erase(stream);
+}
 
 void runHandDetectionProcessFor(
   string &target, Server &server, Value &msg,
-  Mat &frame, Mat &depthFrame, Mat &depthBackground, Mat &proj, vision::cam::CameraPtr &dev,
+  Mat &frame, Mat &depthFrame, Mat &depthBackground, Mat &preparedDepthBackground,
+  Mat &proj, vision::cam::CameraPtr &dev,
+  std::shared_ptr<vision::hand::HandDetector> &detector,
+  std::shared_ptr<vision::hand::HandTracker> &tracker,
+  std::shared_ptr<shm::Transport> &sharedMemory,
   uint maxWidth, uint maxHeight,
   vision::hand::Options &opts,
   bool record)
 {
   // still running?
-  if (!handDetectionActivities[target]) {
-    std::cout << "stopping hand detection for " << target << std::endl;
-    return;
+  {
+    std::lock_guard<std::recursive_mutex> l(serviceLock());
+    if (!handDetectionActivities[target]) {
+      std::cout << "stopping hand detection for " << target << std::endl;
+      return;
+    }
   }
 
   try {
     dev->readWithDepth(frame, depthFrame);
+    double captured = secondsSince(serverStart);
+    bool cameraSpace = detectsInCameraSpace(frame, depthFrame, opts);
 
     vision::hand::FrameWithHands handData;
     Mat recorded;
 
-    recognizeHand(msg, frame, depthFrame, depthBackground, proj, recorded, handData, maxWidth, maxHeight, opts, record);
+    recognizeHand(
+      msg, frame, depthFrame, depthBackground, preparedDepthBackground,
+      proj, lensOf(dev), *detector, recorded, handData,
+      maxWidth, maxHeight, opts, record);
+
+    // ids and smoothing for streams that ask for them (data.tracking: true
+    // or options), timed by when the frame came in
+    Value tracking = msg["data"].get("tracking", Value());
+    if (tracking.isObject() || (tracking.isBool() && tracking.asBool())) {
+      Value trackingData = tracking.isObject() ? tracking : Value(Json::objectValue);
+      tracker->update(handData, captured, trackingOptions(trackingData));
+    }
+
+    // co-located clients read every frame, regardless of subscriptions. The
+    // frames they get are in table space, in point space that is done for
+    // them only
+    if (sharedMemory) {
+      Mat tableFrame = frame;
+      if (cameraSpace && sharedMemory->publishesFrames()) {
+        cv::Size tfmedSize = fittedSize(frame.size(), maxWidth, maxHeight);
+        transformFrame(frame, tableFrame, tfmedSize, tfmedSize, proj, lensOf(dev));
+      }
+      sharedMemory->publish(handData, tableFrame, captured);
+    }
 
     // sendMat(recorded, server, target);
 
-    server->answer(msg, frameWithHandsToJSON(handData), true);
-    
-    Value handEventMsg;
-    handEventMsg["action"] = "hand-event";
-    handEventMsg["target"] = msg["sender"];
-    handEventMsg["data"] = frameWithHandsToJSON(handData);
-    server->send(handEventMsg);
+    // each subscriber gets what is new to it at its rate, see Subscriber.
+    // Encoded once per field selection.
+    auto event = std::make_shared<HandEvent>(handData);
+    {
+      std::lock_guard<std::recursive_mutex> l(serviceLock());
+      for (auto &subscriber : streamSubscribers[target])
+        subscriber->offer(event, captured);
+    }
 
     // sendMat(frame, server, target);
     server->setTimer(20, bind(runHandDetectionProcessFor,
       target, server, msg,
-      frame, depthFrame, depthBackground, proj, dev,
-      maxWidth, maxHeight,
+      frame, depthFrame, depthBackground, preparedDepthBackground, proj, dev,
+      detector, tracker, sharedMemory, maxWidth, maxHeight,
       opts, record));
   } catch (const std::exception& e) {
     std::cout << "error in runHandDetectionProcessFor: " << e.what() << std::endl;
@@ -322,12 +661,16 @@ void runHandDetectionProcessFor(
 // HANDLER
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 // captureCameraService
+// captureCameraAck
 // uploadImageService
 // recognizeScreenCornersService
 // screenCornersTransform
 // screenTransform
 // handDetection
 // handDetectionStreamStop
+// handDetectionStreamSubscribe
+// handDetectionStreamAck
+// handDetectionStreamStats
 // handDetectionStreamStart
 
 void captureCameraService(Value msg, Server server)
@@ -335,19 +678,43 @@ void captureCameraService(Value msg, Server server)
   auto sender = msg.get("sender", "").asString();
   if (sender == "") { answerWithError(server, msg, "no sender"); return; }
   debug = msg["data"]["debug"].asBool();
-  uint maxWidth = msg["data"].get("maxWidth", 0).asInt();
-  uint maxHeight = msg["data"].get("maxHeight", 0).asInt();
   uint nFrames = msg["data"].get("nFrames", 1).asInt();
+  // the first frame's depth is saved there
   string depthFile = msg["data"].get("depthFile", "").asString();
+  // data.jpeg: {quality, gray, scale}, see JpegOptions
+  Value jpegData = msg["data"].get("jpeg", Value(Json::objectValue));
+  JpegOptions jpeg = jpegOptions(jpegData);
+  jpeg.maxWidth = msg["data"].get("maxWidth", 0).asInt();
+  jpeg.maxHeight = msg["data"].get("maxHeight", 0).asInt();
+  // data.depthEncoding: "jpeg" (8 bit, default), "png" (16 bit) or "rvl",
+  // see vision/depth-codec.hpp
+  auto depth = depthEncoding(msg["data"].get("depthEncoding", "jpeg").asString());
+  // data.rate: adapts scale, quality and frame interval, see RateOptions
+  Value rateData = msg["data"].get("rate", Value(Json::objectValue));
+  auto rate = std::make_shared<RateController>(jpeg, rateOptions(rateData));
+  // data.stream: names the stream in acks and metadata, for clients with
+  // more than one
+  string stream = msg["data"].get("stream", "").asString();
   auto cam = getVideoCaptureDev(msg);
-  Mat frame, depthFrame;
-  server->answer(msg, (string)"OK");
-  readFrameAndSend(nFrames, maxWidth, maxHeight, cam, frame, depthFrame, server, sender);
-  if (depthFile != "") {
-    cv::FileStorage fs(depthFile, cv::FileStorage::WRITE);
-    fs << "depth" << depthFrame;
-    fs.release();
+  auto encoder = std::make_shared<PreviewEncoder>();
+  {
+    std::lock_guard<std::recursive_mutex> l(serviceLock());
+    captureStreams[CaptureStream(sender, stream)] = rate;
   }
+  server->answer(msg, (string)"OK");
+  uint frames = 0;
+  readFrameAndSend(nFrames, frames, cam, encoder, rate, depth, depthFile, server, sender, stream);
+}
+
+void captureCameraAck(Value msg, Server server)
+{
+  // a client with rate.acks got count images of data.stream
+  auto sender = msg.get("sender", "").asString();
+  if (sender == "") { answerWithError(server, msg, "no sender"); return; }
+  std::lock_guard<std::recursive_mutex> l(serviceLock());
+  auto stream = captureStreams.find(CaptureStream(sender, msg["data"].get("stream", "").asString()));
+  if (stream == captureStreams.end()) return;
+  stream->second->ack(msg["data"].get("count", 1).asInt(), secondsSince(serverStart));
 }
 
 void uploadImageService(Value msg, Server server)
@@ -389,7 +756,10 @@ void recognizeScreenCornersService(Value msg, Server server)
   vision::screen::Options opts = screenOptions(msg["data"]);
 
   Mat image, depthImage, depthBackgroundImage;
-  uploadedOrCapturedImage(server, sender, msg, image, depthImage, depthBackgroundImage);
+  bool uploaded = uploadedOrCapturedImage(server, sender, msg, image, depthImage, depthBackgroundImage);
+
+  // with a calibrated camera projections live in undistorted coordinates
+  if (!uploaded) vision::warp::undistort(image, image, lensOf(getVideoCaptureDev(msg)));
 
   if (maxWidth > 0 && maxHeight > 0) {
     cvhelper::resizeToFit(image, image, maxWidth, maxHeight);
@@ -481,20 +851,24 @@ void screenTransform(Value msg, Server server)
 
   auto maxWidth = msg["data"].get("maxWidth", 0).asInt();
   auto maxHeight = msg["data"].get("maxHeight", 0).asInt();
-  if (maxWidth > 0 && maxHeight > 0) {
-    cvhelper::resizeToFit(image, image, maxWidth, maxHeight);
-    if (!depthImage.empty()) cvhelper::resizeToFit(depthImage, depthImage, maxWidth, maxHeight);
-    if (!depthBackgroundImage.empty()) cvhelper::resizeToFit(depthBackgroundImage, depthBackgroundImage, maxWidth, maxHeight);
-  }
+  cv::Size fitted = fittedSize(image.size(), maxWidth, maxHeight);
 
   string saveAs = msg["data"].get("saveAs", "").asString();
   if (saveAs != "") {
-    saveHandInput(saveAs, image, depthImage, depthBackgroundImage.empty() ? depthImage : depthBackgroundImage, proj);
+    Mat rgb = image, depth = depthImage, depthBg = depthBackgroundImage;
+    if (maxWidth > 0 && maxHeight > 0) {
+      cvhelper::resizeToFit(image, rgb, maxWidth, maxHeight);
+      if (!depthImage.empty()) cvhelper::resizeToFit(depthImage, depth, maxWidth, maxHeight);
+      if (!depthBackgroundImage.empty()) cvhelper::resizeToFit(depthBackgroundImage, depthBg, maxWidth, maxHeight);
+    }
+    saveHandInput(saveAs, rgb, depth, depthBg.empty() ? depth : depthBg, proj);
   }
 
+  // proj expects frames scaled to fit maxWidth/maxHeight, applying it to the
+  // unscaled image does resize and projection in one pass
   bool debug = false;
   vision::screen::Options opts = screenOptions(msg["data"]);
-  Mat projected = vision::screen::applyScreenProjection(image, proj, image.size(), opts, debug);
+  Mat projected = vision::screen::applyScreenProjection(image, proj, fitted, fitted, opts, debug);
   if (debug) {
     Mat recorded = cvdbg::getAndClearRecordedImages();
     imshow("debug-screenTransform", recorded);
@@ -519,7 +893,7 @@ void handDetection(Value msg, Server server)
   auto playbackFile = msg["data"].get("playbackFile", "").asString();
   auto backgroundFile = msg["data"].get("backgroundFile", "").asString();
 
-  bool record = false;
+  bool record = false, uploaded = true;
   Mat image, depthImage, depthBackground, proj = Mat::eye(3,3,CV_32F);
 
   if (playbackFile != "") {
@@ -534,7 +908,7 @@ void handDetection(Value msg, Server server)
     cv::FileStorage fs(backgroundFile, cv::FileStorage::READ);
     fs["projection"] >> proj;
     fs["depthBackground"] >> depthBackground;
-    uploadedOrCapturedImage(server, sender, msg, image, depthImage, depthBackground);
+    uploaded = uploadedOrCapturedImage(server, sender, msg, image, depthImage, depthBackground);
     record = true;
   } else {
     Value projection = msg["data"]["projection"];
@@ -543,7 +917,7 @@ void handDetection(Value msg, Server server)
         for (int j = 0; j < 3; j++)
           proj.at<float>(i, j) = projection[(i*3)+j].asFloat();
     }
-    uploadedOrCapturedImage(server, sender, msg, image, depthImage, depthBackground);
+    uploaded = uploadedOrCapturedImage(server, sender, msg, image, depthImage, depthBackground);
     record = true;
   }
 
@@ -551,13 +925,25 @@ void handDetection(Value msg, Server server)
 
   vision::hand::Options opts = handOptions(msg["data"]);
   vision::hand::FrameWithHands handData;
-  Mat recorded;
-  recognizeHand(msg, image, depthImage, depthBackground, proj, recorded, handData, maxWidth, maxHeight, opts, record);
+  vision::warp::Lens lens;
+  if (!uploaded) lens = lensOf(getVideoCaptureDev(msg));
+  Mat recorded, preparedDepthBackground;
+  vision::hand::HandDetector detector;
+  recognizeHand(
+    msg, image, depthImage, depthBackground, preparedDepthBackground,
+    proj, lens, detector, recorded, handData,
+    maxWidth, maxHeight, opts, record);
 
   sendMat(recorded, server, sender);
   cv::waitKey(30);
 
-  server->answer(msg, frameWithHandsToJSON(handData));
+  if (server->writesJSON()) {
+    string data;
+    vision::hand::writeFrameWithHandsJSON(handData, data);
+    server->answerJSON(msg, data);
+  } else {
+    server->answer(msg, frameWithHandsToJSON(handData));
+  }
 }
 
 void handDetectionStreamStop(Value msg, Server server)
@@ -565,7 +951,67 @@ void handDetectionStreamStop(Value msg, Server server)
   auto sender = msg.get("sender", "").asString();
   if (sender == "") { answerWithError(server, msg, "no sender"); return; }
   debug = msg["data"]["debug"].asBool();
-  handDetectionActivities[sender] = false;
+  // data.stream of another client leaves that stream, the own one stops
+  auto stream = msg["data"].get("stream", sender).asString();
+  std::lock_guard<std::recursive_mutex> l(serviceLock());
+  if (stream == sender) stopHandDetectionStream(sender);
+  else unsubscribe(Subscription(sender, stream));
+}
+
+void handDetectionStreamSubscribe(Value msg, Server server)
+{
+  // joins the stream that data.stream started, with its own maxRateHz,
+  // fields, encoding and publish options
+  auto sender = msg.get("sender", "").asString();
+  if (sender == "") { answerWithError(server, msg, "no sender"); return; }
+  auto stream = msg["data"].get("stream", "").asString();
+  if (!subscribable(server, msg)) return;
+  std::lock_guard<std::recursive_mutex> l(serviceLock());
+  auto running = handDetectionActivities.find(stream);
+  if (running == handDetectionActivities.end() || !running->second) {
+    answerWithError(server, msg, "no stream " + stream);
+    return;
+  }
+
+  // subscribing again replaces the subscription, to this stream only
+  Subscription subscription(sender, stream);
+  unsubscribe(subscription);
+  auto subscriber = subscriberFor(sender, server, msg);
+  subscribers[subscription] = subscriber;
+  streamSubscribers[stream].push_back(subscriber);
+  server->answer(msg, (string)"OK");
+}
+
+void handDetectionStreamAck(Value msg, Server server)
+{
+  // a client with an ackWindow got count hand events of data.stream, its own
+  // stream if not given
+  auto sender = msg.get("sender", "").asString();
+  if (sender == "") { answerWithError(server, msg, "no sender"); return; }
+  std::lock_guard<std::recursive_mutex> l(serviceLock());
+  auto subscriber = subscribers.find(Subscription(sender, msg["data"].get("stream", sender).asString()));
+  if (subscriber == subscribers.end()) return;
+  subscriber->second->outbound->ack(msg["data"].get("count", 1).asInt(), secondsSince(serverStart));
+}
+
+void handDetectionStreamStats(Value msg, Server server)
+{
+  auto sender = msg.get("sender", "").asString();
+  if (sender == "") { answerWithError(server, msg, "no sender"); return; }
+  std::lock_guard<std::recursive_mutex> l(serviceLock());
+  // of data.stream, as for acks
+  auto subscriber = subscribers.find(Subscription(sender, msg["data"].get("stream", sender).asString()));
+  if (subscriber == subscribers.end()) { answerWithError(server, msg, "no stream"); return; }
+  QueueStats stats = subscriber->second->outbound->stats();
+  Value answer;
+  answer["sent"] = (Json::Int64)stats.sent;
+  answer["coalesced"] = (Json::Int64)stats.coalesced;
+  answer["dropped"] = (Json::Int64)stats.dropped;
+  answer["inFlight"] = stats.inFlight;
+  answer["waiting"] = stats.waiting;
+  answer["lagMs"] = stats.lagMs;
+  answer["maxLagMs"] = stats.maxLagMs;
+  server->answer(msg, answer);
 }
 
 void handDetectionStreamStart(Value msg, Server server)
@@ -574,6 +1020,7 @@ void handDetectionStreamStart(Value msg, Server server)
   // transforms the uploaded image with it
   auto sender = msg.get("sender", "").asString();
   if (sender == "") { answerWithError(server, msg, "no sender"); return; }
+  if (!subscribable(server, msg)) return;
   debug = msg["data"]["debug"].asBool();
   bool record = msg["data"]["record"].asBool();
 
@@ -583,8 +1030,6 @@ void handDetectionStreamStart(Value msg, Server server)
   auto cam = getVideoCaptureDev(msg);
   Mat image, depthImage, depthBackground;
 
-  handDetectionActivities[sender] = true;
-
   Mat proj = Mat::eye(3,3,CV_32F);
   if (backgroundFile != "") {
     dbg << "backgroundFile file: " << backgroundFile << std::endl;
@@ -604,11 +1049,52 @@ void handDetectionStreamStart(Value msg, Server server)
 
   vision::hand::Options opts = handOptions(msg["data"]);
 
-  runHandDetectionProcessFor(sender, server, msg, image, depthImage, depthBackground, proj, cam, maxWidth, maxHeight, opts, record);
+  // filled by the first frame, from then on the background is not touched
+  Mat preparedDepthBackground;
+  auto detector = std::make_shared<vision::hand::HandDetector>();
+  auto tracker = std::make_shared<vision::hand::HandTracker>();
+  {
+    // a restart starts over, without the old stream's subscribers
+    std::lock_guard<std::recursive_mutex> l(serviceLock());
+    stopHandDetectionStream(sender);
+    handDetectionActivities[sender] = true;
+    auto owner = subscriberFor(sender, server, msg);
+    subscribers[Subscription(sender, sender)] = owner;
+    streamSubscribers[sender] = {owner};
+  }
+
+  // data.sharedMemory: {name, frames}, see shm-ring.hpp
+  std::shared_ptr<shm::Transport> sharedMemory;
+  Value shmOptions = msg["data"].get("sharedMemory", Value(Json::objectValue));
+  auto shmName = shmOptions.get("name", "").asString();
+  if (shmName != "") {
+    sharedMemory = std::make_shared<shm::Transport>();
+    if (!sharedMemory->open(shmName, shmOptions["frames"].asBool())) {
+      std::cout << "cannot publish to shared memory " << shmName << std::endl;
+      sharedMemory.reset();
+    }
+  }
+
+  runHandDetectionProcessFor(
+    sender, server, msg,
+    image, depthImage, depthBackground, preparedDepthBackground, proj, cam,
+    detector, tracker, sharedMemory, maxWidth, maxHeight, opts, record);
 
   server->answer(msg, (string)"OK");
 }
 
+void clientGone(const string &sender)
+{
+  std::lock_guard<std::recursive_mutex> l(serviceLock());
+  if (handDetectionActivities.count(sender)) stopHandDetectionStream(sender);
+  for (auto it = subscribers.begin(); it != subscribers.end(); ) {
+    auto subscription = (it++)->first;
+    if (subscription.first == sender) unsubscribe(subscription);
+  }
+  for (auto it = captureStreams.begin(); it != captureStreams.end(); )
+    it = it->first.first == sender ? captureStreams.erase(it) : std::next(it);
+}
+
 
 }
 }
@@ -3,13 +3,13 @@
 
 #include "json/json.h"
 
-#include "l2l.hpp"
-typedef std::shared_ptr<l2l::L2lServer> Server;
+#include "endpoint.hpp"
 
 namespace handdetection {
 namespace server {
   
 void captureCameraService(Json::Value msg, Server server);
+void captureCameraAck(Json::Value msg, Server server);
 void uploadImageService(Json::Value msg, Server server);
 void recognizeScreenCornersService(Json::Value msg, Server server);
 void screenCornersTransform(Json::Value msg, Server server);
@@ -17,6 +17,13 @@ void screenTransform(Json::Value msg, Server server);
 void handDetection(Json::Value msg, Server server);
 void handDetectionStreamStart(Json::Value msg, Server server);
 void handDetectionStreamStop(Json::Value msg, Server server);
+void handDetectionStreamSubscribe(Json::Value msg, Server server);
+void handDetectionStreamAck(Json::Value msg, Server server);
+void handDetectionStreamStats(Json::Value msg, Server server);
+
+// sender disconnected: the hand detection stream it started stops, its
+// subscription and capture-camera streams go away
+void clientGone(const std::string &sender);
 
 }
 }
@@ -0,0 +1,330 @@
+#include "shm-ring.hpp"
+
+#include <iostream>
+#include <cstring>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace handdetection {
+namespace server {
+namespace shm {
+
+// slots start at the first cache line after the header and are cache line
+// aligned themselves
+const size_t slotsOffset = 64;
+
+std::string socketPath(const std::string &name)
+{
+  return "/tmp" + (name[0] == '/' ? name : "/" + name) + ".sock";
+}
+
+#ifdef __linux__
+
+bool sendFd(int socket, int fd)
+{
+  char byte = 0;
+  iovec io{&byte, 1};
+  char control[CMSG_SPACE(sizeof(int))];
+  std::memset(control, 0, sizeof(control));
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &io;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+  return sendmsg(socket, &msg, MSG_NOSIGNAL) == 1;
+}
+
+int receiveFd(int socket)
+{
+  char byte;
+  iovec io{&byte, 1};
+  char control[CMSG_SPACE(sizeof(int))];
+  msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &io;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  if (recvmsg(socket, &msg, 0) != 1) return -1;
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if (!cmsg || cmsg->cmsg_type != SCM_RIGHTS) return -1;
+  int fd;
+  std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+  return fd;
+}
+
+sockaddr_un socketAddress(const std::string &name)
+{
+  sockaddr_un addr;
+  std::memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  std::strncpy(addr.sun_path, socketPath(name).c_str(), sizeof(addr.sun_path) - 1);
+  return addr;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+bool RingWriter::open(const std::string &name, int slotCount, size_t slotSize)
+{
+  close();
+  slotSize = (std::max(slotSize, sizeof(SlotHeader) + 1) + 63) / 64 * 64;
+  length = slotsOffset + slotCount * slotSize;
+
+  // before shm_open, so that close() removes this one when we fail
+  this->name = name;
+  shm_unlink(name.c_str()); // left over from an earlier run
+  shmFd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+  if (shmFd < 0 || ftruncate(shmFd, length) != 0) {
+    std::cout << "cannot create shared memory " << name << ": " << std::strerror(errno) << std::endl;
+    close();
+    return false;
+  }
+  void *memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, shmFd, 0);
+  if (memory == MAP_FAILED) { close(); return false; }
+
+  // ftruncate zeroed everything, all slots start with seq 0
+  header = static_cast<RingHeader*>(memory);
+  header->magic = ringMagic;
+  header->version = ringVersion;
+  header->slotCount = slotCount;
+  header->slotSize = slotSize;
+  header->written.store(0, std::memory_order_release);
+
+  auto addr = socketAddress(name);
+  unlink(addr.sun_path);
+  listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  if (listenFd < 0
+   || bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+   || listen(listenFd, 8) != 0) {
+    std::cout << "cannot listen on " << addr.sun_path << ": " << std::strerror(errno) << std::endl;
+    close();
+    return false;
+  }
+  return true;
+}
+
+void RingWriter::close()
+{
+  // clients that still have it mapped learn that they have to reopen
+  if (header) header->closed.store(1, std::memory_order_release);
+  for (auto &client : clients) {
+    uint64_t one = 1;
+    if (::write(client.notifier, &one, sizeof(one)) < 0) {}
+    ::close(client.connection);
+    ::close(client.notifier);
+  }
+  clients.clear();
+  if (listenFd >= 0) {
+    ::close(listenFd);
+    unlink(socketPath(name).c_str());
+  }
+  if (header) munmap(header, length);
+  if (shmFd >= 0) {
+    ::close(shmFd);
+    shm_unlink(name.c_str());
+  }
+  listenFd = shmFd = -1;
+  header = nullptr;
+}
+
+size_t RingWriter::payloadSize() const
+{
+  return header ? header->slotSize - sizeof(SlotHeader) : 0;
+}
+
+void RingWriter::acceptClients()
+{
+  int connection;
+  while ((connection = accept(listenFd, nullptr, nullptr)) >= 0) {
+    int notifier = eventfd(0, EFD_NONBLOCK);
+    if (notifier < 0 || !sendFd(connection, notifier)) {
+      if (notifier >= 0) ::close(notifier);
+      ::close(connection);
+      continue;
+    }
+    clients.push_back(Client{connection, notifier});
+  }
+}
+
+void RingWriter::notifyClients()
+{
+  // one poll for all clients, only those that sent a byte (they wait) or
+  // closed their connection (they are gone) need more
+  if (clients.empty()) return;
+  std::vector<pollfd> connections;
+  for (auto &client : clients) connections.push_back(pollfd{client.connection, POLLIN, 0});
+  if (poll(connections.data(), connections.size(), 0) <= 0) return;
+
+  for (size_t i = clients.size(); i-- > 0; )
+  {
+    if (connections[i].revents == 0) continue;
+    char bytes[64];
+    ssize_t n = recv(clients[i].connection, bytes, sizeof(bytes), MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      ::close(clients[i].connection);
+      ::close(clients[i].notifier);
+      clients.erase(clients.begin() + i);
+      continue;
+    }
+    uint64_t one = 1;
+    if (n > 0 && ::write(clients[i].notifier, &one, sizeof(one)) < 0) {} // full counter, the client knows anyway
+  }
+}
+
+bool RingWriter::write(RecordKind kind, double time, const void *head, size_t headSize, const void *body, size_t bodySize)
+{
+  if (!header || headSize + bodySize > payloadSize()) return false;
+  acceptClients();
+
+  uint64_t index = header->written.load(std::memory_order_relaxed);
+  auto slot = reinterpret_cast<SlotHeader*>(
+    reinterpret_cast<uchar*>(header) + slotsOffset + (index % header->slotCount) * header->slotSize);
+  auto payload = reinterpret_cast<uchar*>(slot + 1);
+
+  uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+  slot->seq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->kind = kind;
+  slot->size = headSize + bodySize;
+  slot->index = index;
+  slot->time = time;
+  std::memcpy(payload, head, headSize);
+  if (bodySize > 0) std::memcpy(payload + headSize, body, bodySize);
+  slot->seq.store(seq + 2, std::memory_order_release);
+
+  header->written.store(index + 1, std::memory_order_release);
+  notifyClients();
+  return true;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+bool RingReader::open(const std::string &name)
+{
+  close();
+  struct stat info;
+  shmFd = shm_open(name.c_str(), O_RDONLY, 0);
+  if (shmFd < 0 || fstat(shmFd, &info) != 0 || (size_t)info.st_size < slotsOffset) {
+    close();
+    return false;
+  }
+  length = info.st_size;
+  void *memory = mmap(nullptr, length, PROT_READ, MAP_SHARED, shmFd, 0);
+  if (memory == MAP_FAILED) { close(); return false; }
+  header = static_cast<const RingHeader*>(memory);
+  if (header->magic != ringMagic || header->version != ringVersion
+   || slotsOffset + header->slotCount * header->slotSize > length) {
+    close();
+    return false;
+  }
+
+  // The server hands out notifiers when it writes the next record. Without
+  // one the client can still poll written().
+  auto addr = socketAddress(name);
+  timeval timeout{1, 0};
+  connectionFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (connectionFd >= 0
+   && setsockopt(connectionFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) == 0
+   && connect(connectionFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+    notifierFd = receiveFd(connectionFd);
+  return true;
+}
+
+bool RingReader::wait(uint64_t index, int timeoutMs)
+{
+  // ask for a notification, then look again: a record written before the
+  // server saw the request is not missed that way
+  if (closed() || written() > index) return true;
+  char byte = 1;
+  if (notifierFd < 0 || send(connectionFd, &byte, 1, MSG_NOSIGNAL) != 1) return false;
+  if (closed() || written() > index) return true;
+  pollfd fd{notifierFd, POLLIN, 0};
+  uint64_t count;
+  if (poll(&fd, 1, timeoutMs) == 1 && ::read(notifierFd, &count, sizeof(count)) < 0) {}
+  return closed() || written() > index;
+}
+
+void RingReader::close()
+{
+  if (notifierFd >= 0) ::close(notifierFd);
+  if (connectionFd >= 0) ::close(connectionFd);
+  if (header) munmap(const_cast<RingHeader*>(header), length);
+  if (shmFd >= 0) ::close(shmFd);
+  shmFd = connectionFd = notifierFd = -1;
+  header = nullptr;
+}
+
+const SlotHeader* RingReader::slot(uint64_t index) const
+{
+  return reinterpret_cast<const SlotHeader*>(
+    reinterpret_cast<const uchar*>(header) + slotsOffset + (index % header->slotCount) * header->slotSize);
+}
+
+#else
+
+bool RingWriter::open(const std::string &name, int slotCount, size_t slotSize)
+{
+  std::cout << "shared memory transport is not supported on this platform" << std::endl;
+  return false;
+}
+void RingWriter::close() {}
+size_t RingWriter::payloadSize() const { return 0; }
+bool RingWriter::write(RecordKind, double, const void*, size_t, const void*, size_t) { return false; }
+void RingWriter::acceptClients() {}
+void RingWriter::notifyClients() {}
+
+bool RingReader::open(const std::string &name) { return false; }
+bool RingReader::wait(uint64_t index, int timeoutMs) { return false; }
+void RingReader::close() {}
+const SlotHeader* RingReader::slot(uint64_t index) const { return nullptr; }
+
+#endif
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+bool Transport::open(const std::string &name, bool withFrames)
+{
+  this->name = name[0] == '/' ? name : "/" + name;
+  this->withFrames = withFrames;
+  // a frame with 16 hands of five finger tips is about 1.5k
+  return hands.open(this->name + "-hands", 64, 8192);
+}
+
+void Transport::publish(vision::hand::FrameWithHands &handData, const cv::Mat &frame, double time)
+{
+  vision::hand::frameWithHandsToBinary(handData, encoded);
+  hands.write(handFrame, time, &encoded[0], encoded.size());
+
+  if (!withFrames || frame.empty()) return;
+  cv::Mat pixels = frame.isContinuous() ? frame : frame.clone();
+  ImageHeader imageHeader{pixels.rows, pixels.cols, pixels.type(), (int32_t)(pixels.cols * pixels.elemSize())};
+  size_t size = (size_t)pixels.rows * imageHeader.step,
+         recordSize = sizeof(imageHeader) + size;
+  // sized for the frames we get. When they grow the old ring is closed,
+  // clients open the new one
+  if (frames.payloadSize() < recordSize && !frames.open(name + "-frames", 4, sizeof(SlotHeader) + recordSize)) {
+    withFrames = false;
+    return;
+  }
+  frames.write(image, time, &imageHeader, sizeof(imageHeader), pixels.data, size);
+}
+
+}
+}
+}
@@ -0,0 +1,172 @@
+#ifndef HAND_DETECTOR_SERVER_SHM_RING_H_
+#define HAND_DETECTOR_SERVER_SHM_RING_H_
+
+/*
+Hand events and frames for clients on the same host, without l2l, JSON or
+JPEG. The server writes records into rings of fixed size slots in POSIX
+shared memory, clients map the same memory and read them in place.
+
+A ring (the shared memory object `name`) is a RingHeader followed by
+slotCount slots of slotSize bytes, each a SlotHeader plus the payload.
+Record i goes into slot i % slotCount. Every slot is guarded by a seqlock:
+its seq is odd while the server writes it. A reader reads seq, the payload,
+then seq again. If that changed the slot was overwritten meanwhile, the
+reader was too slow for that record.
+
+New records are announced through an eventfd per client. Clients get theirs
+by connecting to the Unix socket /tmp/<name>.sock, the server passes it
+over with SCM_RIGHTS. Only clients that wait are woken: before it blocks a
+client sends a byte over that socket (RingReader::wait), the server polls
+all sockets once per record and writes the eventfds of those that sent one.
+Clients that keep up without waiting cost it nothing. Linux only for now
+(eventfd), elsewhere open fails and streams run without shared memory.
+
+When the server is done with a ring it sets closed in its header and wakes
+the clients, then removes it. That also happens when frames outgrow their
+slots: a bigger ring replaces the old one under the same name. Clients that
+see closed open the name again.
+
+Image records are table space frames, as the hand coordinates are.
+*/
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "vision/hand-detection.hpp"
+
+namespace handdetection {
+namespace server {
+namespace shm {
+
+const uint32_t ringMagic = 0x474e4952; // "RING"
+const uint16_t ringVersion = 1;
+
+enum RecordKind : uint32_t
+{
+  handFrame = 1, // payload: frameWithHandsToBinary
+  image = 2      // payload: ImageHeader, then rows * step bytes
+};
+
+struct RingHeader
+{
+  uint32_t magic;
+  uint16_t version;
+  uint16_t slotCount;
+  uint32_t slotSize; // including the SlotHeader
+  std::atomic<uint32_t> closed; // 1: replaced or gone, open the name again
+  std::atomic<uint64_t> written; // records so far, the next one is written
+};
+
+struct SlotHeader
+{
+  std::atomic<uint32_t> seq; // odd while being written
+  uint32_t kind;
+  uint32_t size;  // of the payload
+  uint32_t reserved;
+  uint64_t index; // of the record
+  double time;    // seconds, when the frame was captured
+};
+
+struct ImageHeader
+{
+  int32_t rows, cols, type, step; // as cv::Mat
+};
+
+std::string socketPath(const std::string &name);
+
+class RingWriter
+{
+  public:
+    RingWriter() = default;
+    RingWriter(const RingWriter&) = delete;
+    RingWriter& operator=(const RingWriter&) = delete;
+    ~RingWriter() { close(); };
+    // Creates (or replaces) the shared memory object and the socket clients
+    // get their eventfd from. False if that is not possible here.
+    bool open(const std::string &name, int slotCount, size_t slotSize);
+    void close();
+    bool isOpen() const { return header != nullptr; };
+    size_t payloadSize() const;
+    // Payload is head followed by body. False if it does not fit a slot.
+    bool write(RecordKind, double time, const void *head, size_t headSize, const void *body = nullptr, size_t bodySize = 0);
+
+  private:
+    void acceptClients();
+    void notifyClients();
+
+    struct Client { int connection, notifier; };
+    std::string name;
+    int shmFd = -1, listenFd = -1;
+    size_t length = 0;
+    RingHeader *header = nullptr;
+    std::vector<Client> clients;
+};
+
+class RingReader
+{
+  public:
+    RingReader() = default;
+    RingReader(const RingReader&) = delete;
+    RingReader& operator=(const RingReader&) = delete;
+    ~RingReader() { close(); };
+    bool open(const std::string &name);
+    void close();
+    // Until record index is written or the ring closed, at most timeoutMs.
+    // False on timeout, or right away if there is no notifier.
+    bool wait(uint64_t index, int timeoutMs);
+    // the eventfd the server writes when this reader waits, -1 if the
+    // server did not hand one out. To poll it along with other fds call
+    // wait(index, 0) first, that asks for the notification.
+    int notifier() const { return notifierFd; };
+    uint64_t written() const { return header->written.load(std::memory_order_acquire); };
+    // the server closed the ring, nothing new comes here
+    bool closed() const { return header->closed.load(std::memory_order_acquire) != 0; };
+    // Calls use(slot, payload) for record index, in place. False if the
+    // record is not there (yet or anymore) or the ring is closed, also when
+    // it was overwritten while use looked at it: then whatever use got has
+    // to be discarded.
+    template<typename Use>
+    bool read(uint64_t index, Use use) const;
+
+  private:
+    const SlotHeader* slot(uint64_t index) const;
+    int shmFd = -1, connectionFd = -1, notifierFd = -1;
+    size_t length = 0;
+    const RingHeader *header = nullptr;
+};
+
+template<typename Use>
+bool RingReader::read(uint64_t index, Use use) const
+{
+  if (closed() || index >= written() || written() - index > header->slotCount) return false;
+  const SlotHeader *s = slot(index);
+  uint32_t before = s->seq.load(std::memory_order_acquire);
+  if (before & 1 || s->index != index) return false;
+  use(*s, reinterpret_cast<const uchar*>(s + 1));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return s->seq.load(std::memory_order_relaxed) == before;
+}
+
+// What a stream publishes to shared memory: all hand frames and, if asked
+// for, the frames it looked at (in table space)
+class Transport
+{
+  public:
+    bool open(const std::string &name, bool withFrames);
+    bool publishesFrames() const { return withFrames; };
+    void publish(vision::hand::FrameWithHands&, const cv::Mat &frame, double time);
+
+  private:
+    std::string name;
+    bool withFrames = false;
+    RingWriter hands, frames;
+    std::vector<uchar> encoded;
+};
+
+}
+}
+}
+
+#endif  // HAND_DETECTOR_SERVER_SHM_RING_H_
@@ -0,0 +1,327 @@
+#include "unix-socket.hpp"
+#include <atomic>
+#include <algorithm>
+#include <deque>
+#include <set>
+#include <iostream>
+#include <unistd.h>
+
+namespace handdetection {
+namespace server {
+
+using boost::asio::local::stream_protocol;
+using std::string;
+using std::vector;
+
+const size_t frameHeaderSize = 5;
+
+vector<uchar> frame(uchar kind, const uchar *payload, size_t size)
+{
+  vector<uchar> out(frameHeaderSize + size);
+  out[0] = kind;
+  for (int i = 0; i < 4; i++) out[1 + i] = (uchar)(size >> (8 * i));
+  std::copy(payload, payload + size, out.begin() + frameHeaderSize);
+  return out;
+}
+
+// msg (without data) as JSON with data, JSON text already, spliced in
+string withData(const Json::Value &msg, const string &data)
+{
+  string json = Json::FastWriter().write(msg);
+  size_t close = json.rfind('}'), dataEnd = data.find_last_not_of('\n') + 1;
+  json.resize(close);
+  if (close > 1) json += ',';
+  json += "\"data\":";
+  json.append(data, 0, dataEnd);
+  json += "}\n";
+  return json;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+class Connection : public std::enable_shared_from_this<Connection>
+{
+  public:
+    Connection(boost::asio::io_service &io, const string &id, const std::map<string, Service> &services,
+               const std::function<void(const string&)> &gone)
+      : io(io), strand(io), socket(io), id(id), services(services), gone(gone) {};
+
+    void start() { readHeader(); }
+
+    // thread safe, services may run on the l2l server's thread. written
+    // runs on the connection's strand once the socket took the frame.
+    void write(vector<uchar> frame, std::function<void()> written = nullptr)
+    {
+      queued++;
+      auto self = shared_from_this();
+      strand.post([self, frame, written]() {
+        self->outgoing.push_back(frame);
+        self->onWritten.push_back(written);
+        if (self->outgoing.size() == 1) self->writeNext();
+      });
+    }
+
+    void whenWritten(std::function<void()> fn)
+    {
+      auto self = shared_from_this();
+      strand.post([self, fn]() {
+        if (self->outgoing.empty()) { fn(); return; }
+        auto &last = self->onWritten.back();
+        auto before = last;
+        last = [before, fn]() { if (before) before(); fn(); };
+      });
+    }
+
+    // services of this connection run on its strand, as do uploads
+    bool takeUpload(vector<uchar> &data)
+    {
+      if (uploads.empty()) return false;
+      data.swap(uploads.front());
+      uploads.clear();
+      return true;
+    }
+
+    boost::asio::io_service &io;
+    // everything of the connection runs one at a time, other connections'
+    // services run meanwhile on the server's other threads
+    boost::asio::io_service::strand strand;
+    stream_protocol::socket socket;
+    const string id;
+    std::atomic<int> queued{0}; // frames handed to write, not written yet
+
+  private:
+    void readHeader();
+    void readPayload();
+    void dispatch();
+    void writeNext();
+    void close();
+
+    const std::map<string, Service> &services;
+    const std::function<void(const string&)> &gone;
+    std::set<string> senders;
+    uchar header[frameHeaderSize];
+    vector<uchar> payload;
+    vector<vector<uchar>> uploads;
+    std::deque<vector<uchar>> outgoing;
+    std::deque<std::function<void()>> onWritten;
+};
+
+// The endpoint services get for a message of a connection. Only refers to
+// the connection, subscribers keep it around after the client is gone.
+class ConnectionEndpoint : public Endpoint
+{
+  public:
+    ConnectionEndpoint(std::shared_ptr<Connection> connection)
+      : connection(connection), io(connection->io), id(connection->id) {};
+
+    void answer(Json::Value &msg, const Json::Value &data, bool expectMore)
+    {
+      Json::Value answer = answerTo(msg, expectMore);
+      answer["data"] = data;
+      send(answer);
+    }
+
+    void send(const Json::Value &msg) { write(Json::FastWriter().write(msg)); }
+
+    void answerJSON(Json::Value &msg, const string &data, bool expectMore)
+    {
+      write(withData(answerTo(msg, expectMore), data));
+    }
+
+    void sendJSON(const Json::Value &msg, const string &data) { write(withData(msg, data)); }
+
+    bool writesJSON() const { return true; }
+
+    void sendBinary(const string &target, const uchar *data, size_t size, std::function<void()> written)
+    {
+      if (auto c = connection.lock()) c->write(frame('b', data, size), written);
+    }
+
+    bool takeUploadedBinaryData(const string &sender, vector<uchar> &data)
+    {
+      auto c = connection.lock();
+      return c && c->takeUpload(data);
+    }
+
+    int queuedFor(const string &target)
+    {
+      auto c = connection.lock();
+      return c ? c->queued.load() : -1;
+    }
+
+    void whenWritten(const string &target, std::function<void()> fn)
+    {
+      if (auto c = connection.lock()) c->whenWritten(fn);
+    }
+
+    // the client's streams end with its connection
+    void setTimer(int ms, std::function<void()> fn)
+    {
+      auto c = connection.lock();
+      if (!c) return;
+      auto timer = std::make_shared<boost::asio::deadline_timer>(io, boost::posix_time::milliseconds(ms));
+      std::weak_ptr<Connection> connection = this->connection;
+      timer->async_wait(c->strand.wrap([timer, fn, connection](const boost::system::error_code &err) {
+        auto c = connection.lock();
+        if (err || !c || !c->socket.is_open()) return;
+        fn();
+      }));
+    }
+
+  private:
+    Json::Value answerTo(Json::Value &msg, bool expectMore)
+    {
+      Json::Value answer;
+      answer["action"] = msg["action"].asString() + "Result";
+      answer["inResponseTo"] = msg["messageId"];
+      answer["target"] = msg["sender"];
+      answer["sender"] = id;
+      if (expectMore) answer["expectMoreResponses"] = true;
+      return answer;
+    }
+
+    void write(const string &json)
+    {
+      if (auto c = connection.lock())
+        c->write(frame('j', reinterpret_cast<const uchar*>(json.data()), json.size()));
+    }
+
+    std::weak_ptr<Connection> connection;
+    boost::asio::io_service &io;
+    string id;
+};
+
+void Connection::readHeader()
+{
+  auto self = shared_from_this();
+  boost::asio::async_read(socket, boost::asio::buffer(header, frameHeaderSize),
+    strand.wrap([self](const boost::system::error_code &err, size_t) {
+      if (err) { self->close(); return; }
+      uint32_t size = 0;
+      for (int i = 0; i < 4; i++) size |= (uint32_t)self->header[1 + i] << (8 * i);
+      if (size > maxFrameSize) {
+        std::cout << "unix socket: frame of " << size << " bytes, closing" << std::endl;
+        self->close();
+        return;
+      }
+      self->payload.resize(size);
+      self->readPayload();
+    }));
+}
+
+void Connection::readPayload()
+{
+  auto self = shared_from_this();
+  boost::asio::async_read(socket, boost::asio::buffer(payload),
+    strand.wrap([self](const boost::system::error_code &err, size_t) {
+      if (err) { self->close(); return; }
+      if (self->header[0] == 'b') {
+        self->uploads.push_back(std::move(self->payload));
+        self->payload = vector<uchar>();
+      } else {
+        self->dispatch();
+      }
+      self->readHeader();
+    }));
+}
+
+void Connection::dispatch()
+{
+  Json::Value msg;
+  Json::Reader reader;
+  const char *json = reinterpret_cast<const char*>(payload.data());
+  if (!reader.parse(json, json + payload.size(), msg) || !msg.isObject()) {
+    std::cout << "unix socket: cannot parse message" << std::endl;
+    return;
+  }
+
+  auto sender = msg.get("sender", "").asString();
+  if (sender != "") senders.insert(sender);
+
+  Server endpoint = std::make_shared<ConnectionEndpoint>(shared_from_this());
+  auto action = msg.get("action", "").asString();
+  auto service = services.find(action);
+  if (service == services.end()) {
+    Json::Value error;
+    error["error"] = true;
+    error["message"] = "no service " + action;
+    endpoint->answer(msg, error);
+    return;
+  }
+
+  // services lock what they share themselves, see serviceLock
+  try {
+    service->second(msg, endpoint);
+  } catch (const std::exception& e) {
+    std::cout << "error in " << action << ": " << e.what() << std::endl;
+  }
+}
+
+void Connection::writeNext()
+{
+  auto self = shared_from_this();
+  boost::asio::async_write(socket, boost::asio::buffer(outgoing.front()),
+    strand.wrap([self](const boost::system::error_code &err, size_t) {
+      if (err) { self->close(); return; }
+      auto written = self->onWritten.front();
+      self->outgoing.pop_front();
+      self->onWritten.pop_front();
+      self->queued--;
+      if (written) written();
+      if (!self->outgoing.empty()) self->writeNext();
+    }));
+}
+
+void Connection::close()
+{
+  if (!socket.is_open()) return;
+  boost::system::error_code ignored;
+  socket.close(ignored);
+  queued -= outgoing.size();
+  outgoing.clear();
+  onWritten.clear();
+  for (auto &sender : senders) gone(sender);
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+UnixSocketServer::UnixSocketServer(
+  const string &path, const string &id, const std::map<string, Service> &services,
+  std::function<void(const string&)> gone)
+  : path(path), id(id), services(services), gone(gone), acceptor(io) {}
+
+UnixSocketServer::~UnixSocketServer() { stop(); }
+
+void UnixSocketServer::start()
+{
+  ::unlink(path.c_str());
+  stream_protocol::endpoint endpoint(path);
+  acceptor.open(endpoint.protocol());
+  acceptor.bind(endpoint);
+  acceptor.listen();
+  accept();
+  unsigned n = std::max(2u, std::thread::hardware_concurrency());
+  for (unsigned i = 0; i < n; i++) threads.emplace_back([this]() { io.run(); });
+  std::cout << "listening on " << path << std::endl;
+}
+
+void UnixSocketServer::stop()
+{
+  io.stop();
+  for (auto &thread : threads) thread.join();
+  threads.clear();
+  boost::system::error_code ignored;
+  if (acceptor.is_open()) { acceptor.close(ignored); ::unlink(path.c_str()); }
+}
+
+void UnixSocketServer::accept()
+{
+  auto connection = std::make_shared<Connection>(io, id, services, gone);
+  acceptor.async_accept(connection->socket, [this, connection](const boost::system::error_code &err) {
+    if (!err) connection->start();
+    accept();
+  });
+}
+
+}
+}
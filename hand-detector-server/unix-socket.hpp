@@ -0,0 +1,66 @@
+#ifndef HAND_DETECTOR_SERVER_UNIX_SOCKET_H_
+#define HAND_DETECTOR_SERVER_UNIX_SOCKET_H_
+
+/*
+The services for clients on the same host, over a Unix domain socket
+instead of TCP loopback.
+
+Messages are the ones l2l clients send and get ({action, sender, messageId,
+data}, answers with inResponseTo and expectMoreResponses). On the socket
+every message is a frame:
+
+  kind    uint8            'j': a JSON message, 'b': binary data
+  size    uint32 (LE)      of the payload
+  payload size bytes
+
+Binary frames are what l2l's binary messages are: uploads a client sends
+right before the message that uses them (upload-image, hand-detection,
+...), and images or binary hand events the server sends to the client.
+*/
+
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+#include "endpoint.hpp"
+
+namespace handdetection {
+namespace server {
+
+const uint32_t maxFrameSize = 64 * 1024 * 1024;
+
+class UnixSocketServer
+{
+  public:
+    // id: what answers carry as sender, as for l2l::startServer. gone: called
+    // with each sender a connection had messages from once it closes, the
+    // client's timers stop firing then.
+    UnixSocketServer(const std::string &path, const std::string &id,
+                     const std::map<std::string, Service> &services,
+                     std::function<void(const std::string&)> gone);
+    ~UnixSocketServer();
+    // Listens at path (replacing what is there) and serves in threads of
+    // its own. Each connection's messages, timers and writes run one at a
+    // time, different connections in parallel: one client's slow service
+    // does not hold up the others.
+    void start();
+    void stop();
+
+  private:
+    void accept();
+
+    std::string path, id;
+    std::map<std::string, Service> services;
+    std::function<void(const std::string&)> gone;
+    boost::asio::io_service io;
+    boost::asio::local::stream_protocol::acceptor acceptor;
+    std::vector<std::thread> threads;
+};
+
+}
+}
+
+#endif  // HAND_DETECTOR_SERVER_UNIX_SOCKET_H_
@@ -0,0 +1,98 @@
+#include "vision/blobs.hpp"
+#include <cstring>
+
+namespace vision {
+namespace blobs {
+
+using cv::Mat;
+using cv::Rect;
+
+int Components::root(int run)
+{
+  while (parent[run] != run) {
+    parent[run] = parent[parent[run]];
+    run = parent[run];
+  }
+  return run;
+}
+
+void Components::join(int a, int b)
+{
+  // the smaller index stays root, so a blob's root is its topmost run
+  a = root(a); b = root(b);
+  if (a < b) parent[b] = a;
+  else if (b < a) parent[a] = b;
+}
+
+void Components::label(const Mat &mask)
+{
+  CV_Assert(mask.type() == CV_8UC1);
+  runs.clear(); parent.clear(); runOrder.clear(); firstRunOf.clear(); found.clear();
+
+  // runs of the previous row are runs[prevBegin..prevEnd)
+  size_t prevBegin = 0, prevEnd = 0;
+  for (int y = 0; y < mask.rows; y++)
+  {
+    const uchar *row = mask.ptr<uchar>(y);
+    size_t rowBegin = runs.size(), prev = prevBegin;
+    int x = 0;
+    while (x < mask.cols)
+    {
+      while (x < mask.cols && !row[x]) x++;
+      if (x == mask.cols) break;
+      int start = x;
+      while (x < mask.cols && row[x]) x++;
+
+      int run = runs.size();
+      runs.push_back(Run{y, start, x});
+      parent.push_back(run);
+
+      // 8-connected: a run above touches us when it overlaps [start-1, x]
+      while (prev < prevEnd && runs[prev].end < start) prev++;
+      for (size_t above = prev; above < prevEnd && runs[above].start <= x; above++)
+        join(run, above);
+    }
+    prevBegin = rowBegin;
+    prevEnd = runs.size();
+  }
+
+  // number the roots in scan order and sum up what belongs to them
+  std::vector<int> blobOf(runs.size()), blobOfRoot(runs.size(), -1);
+  for (size_t i = 0; i < runs.size(); i++)
+  {
+    const Run &r = runs[i];
+    Rect runBounds(r.start, r.row, r.end - r.start, 1);
+    int rootRun = root(i);
+    if (blobOfRoot[rootRun] < 0) {
+      blobOfRoot[rootRun] = found.size();
+      found.push_back(Blob{0, runBounds});
+    }
+    Blob &blob = found[blobOfRoot[rootRun]];
+    blob.area += r.end - r.start;
+    blob.bounds |= runBounds;
+    blobOf[i] = blobOfRoot[rootRun];
+  }
+
+  // group the runs by blob so that render does not have to search
+  firstRunOf.assign(found.size() + 1, 0);
+  for (int b : blobOf) firstRunOf[b + 1]++;
+  for (size_t b = 0; b < found.size(); b++) firstRunOf[b + 1] += firstRunOf[b];
+  std::vector<int> next(firstRunOf.begin(), firstRunOf.end() - 1);
+  runOrder.resize(runs.size());
+  for (size_t i = 0; i < runs.size(); i++) runOrder[next[blobOf[i]]++] = i;
+}
+
+void Components::render(size_t i, Mat &out) const
+{
+  const Blob &blob = found[i];
+  out = Mat::zeros(blob.bounds.height + 2, blob.bounds.width + 2, CV_8UC1);
+  for (int k = firstRunOf[i]; k < firstRunOf[i + 1]; k++)
+  {
+    const Run &r = runs[runOrder[k]];
+    uchar *row = out.ptr<uchar>(r.row - blob.bounds.y + 1);
+    std::memset(row + r.start - blob.bounds.x + 1, 255, r.end - r.start);
+  }
+}
+
+} // blobs
+} // vision
@@ -0,0 +1,50 @@
+#ifndef BLOBS_H_
+#define BLOBS_H_
+
+/*
+Connected components of a binary mask, found on its runs instead of its
+pixels: one scan collects the horizontal runs of non-zero pixels, runs that
+touch a run of the previous row (8-connected) are merged with union-find.
+Area and bounding box of every component fall out of that scan, so blobs
+can be dismissed before anybody traces their contour. A mask with hundreds
+of speckles costs hardly more than a clean one.
+*/
+
+#include <opencv2/opencv.hpp>
+
+namespace vision {
+namespace blobs {
+
+struct Blob
+{
+  long area;       // number of pixels
+  cv::Rect bounds;
+};
+
+class Components
+{
+  public:
+    // mask: CV_8UC1, everything non-zero is foreground
+    void label(const cv::Mat &mask);
+    const std::vector<Blob>& blobs() const { return found; };
+    // Only the pixels of blobs()[i]. out has the size of its bounds plus a
+    // one pixel border (findContours ignores the outermost pixels), so its
+    // origin is bounds.tl() - (1,1).
+    void render(size_t i, cv::Mat &out) const;
+
+  private:
+    struct Run { int row, start, end; }; // end is exclusive
+    int root(int run);
+    void join(int a, int b);
+
+    std::vector<Run> runs;
+    std::vector<int> parent;     // union-find over run indexes
+    std::vector<int> runOrder;   // run indexes grouped by blob
+    std::vector<int> firstRunOf; // blob i owns runOrder[firstRunOf[i]..firstRunOf[i+1]]
+    std::vector<Blob> found;
+};
+
+}
+}
+
+#endif  // BLOBS_H_
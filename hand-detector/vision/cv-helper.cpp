@@ -15,11 +15,9 @@ const Scalar randomColor() {
     return Scalar(rng.uniform(0, 255), rng.uniform(0,255), rng.uniform(0,255));
 }
 
-void resizeToFit(Mat &in, Mat &out, float maxWidth, float maxHeight)
+Size sizeToFit(Size size, float maxWidth, float maxHeight)
 {
-  cv::Size size = in.size();
-  if (size.width <= maxWidth && size.height <= maxHeight)
-  { if (&in != &out) out = in; return; }
+  if (size.width <= maxWidth && size.height <= maxHeight) return size;
 
   float h = size.height, w = size.width;
   if (h > maxHeight) {
@@ -30,7 +28,24 @@ void resizeToFit(Mat &in, Mat &out, float maxWidth, float maxHeight)
     h = round(h * (maxWidth / w));
     w = maxWidth;
   }
-  resize(in, out, Size(w,h));
+  return Size(w,h);
+}
+
+void resizeToFit(Mat &in, Mat &out, float maxWidth, float maxHeight)
+{
+  Size fitted = sizeToFit(in.size(), maxWidth, maxHeight);
+  if (fitted == in.size())
+  { if (&in != &out) out = in; return; }
+  resize(in, out, fitted);
+}
+
+void depthToMillimeters(const Mat &in, Mat &out)
+{
+  if (in.empty() || in.type() == CV_16UC1) { if (&in != &out) out = in; return; }
+  // rounds and saturates, invalid (inf / nan) readings end up as 0
+  Mat mm;
+  in.convertTo(mm, CV_16U);
+  out = mm;
 }
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -34,9 +34,14 @@ template void drawPointsConnected<cv::Point >(std::vector<cv::Point >, cv::Mat&)
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 void resizeToFit(cv::Mat&, cv::Mat&, float, float);
+cv::Size sizeToFit(cv::Size, float, float);
 
 const cv::Scalar randomColor();
 
+// Depth frames are CV_16UC1 millimetres, 0 meaning no reading. Older
+// recordings and uploads are CV_32FC1, this brings them into that format.
+void depthToMillimeters(const cv::Mat&, cv::Mat&);
+
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
 void convertToProperGrayscale(cv::Mat&, float percentile=5.0f);
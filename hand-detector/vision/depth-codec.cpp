@@ -0,0 +1,161 @@
+#include "vision/depth-codec.hpp"
+#include <algorithm>
+#include "vision/cv-helper.hpp"
+
+namespace vision {
+namespace depth {
+
+using cv::Mat;
+using std::vector;
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// RVL
+
+static void putU32(vector<uchar> &out, uint32_t v)
+{
+  for (int i = 0; i < 4; i++) out.push_back((uchar)(v >> (8 * i)));
+}
+
+static uint32_t getU32(const uchar *p)
+{
+  return p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+class NibbleWriter
+{
+  public:
+    NibbleWriter(vector<uchar> &out) : out(out) {};
+
+    // 3 bits at a time, the 4th says whether more follow
+    void vle(uint32_t value)
+    {
+      do {
+        uint32_t nibble = value & 0x7;
+        if (value >>= 3) nibble |= 0x8;
+        word = (word << 4) | nibble;
+        if (++nibbles == 8) { putU32(out, word); word = 0; nibbles = 0; }
+      } while (value);
+    }
+
+    void flush() { if (nibbles) putU32(out, word << 4 * (8 - nibbles)); }
+
+  private:
+    vector<uchar> &out;
+    uint32_t word = 0;
+    int nibbles = 0;
+};
+
+class NibbleReader
+{
+  public:
+    NibbleReader(const uchar *data, const uchar *end) : data(data), end(end) {};
+
+    bool vle(uint32_t &value)
+    {
+      value = 0;
+      for (int shift = 0; shift < 32; shift += 3) {
+        if (!nibbles) {
+          if (end - data < 4) return false;
+          word = getU32(data); data += 4; nibbles = 8;
+        }
+        uint32_t nibble = word >> 28;
+        word <<= 4; nibbles--;
+        value |= (nibble & 0x7) << shift;
+        if (!(nibble & 0x8)) return true;
+      }
+      return false;
+    }
+
+  private:
+    const uchar *data, *end;
+    uint32_t word = 0;
+    int nibbles = 0;
+};
+
+void encodeRVL(const Mat &depth, vector<uchar> &out)
+{
+  CV_Assert(depth.type() == CV_16UC1);
+  Mat continuous = depth.isContinuous() ? depth : depth.clone();
+  const ushort *p = continuous.ptr<ushort>(), *end = p + continuous.total();
+
+  out.clear();
+  out.reserve(rvlHeaderSize + continuous.total()); // about half of the raw size
+  putU32(out, rvlMagic);
+  putU32(out, depth.rows);
+  putU32(out, depth.cols);
+
+  NibbleWriter w(out);
+  int previous = 0;
+  while (p != end)
+  {
+    const ushort *start = p;
+    while (p != end && !*p) p++;
+    w.vle(p - start);
+
+    start = p;
+    while (p != end && *p) p++;
+    w.vle(p - start);
+
+    for (const ushort *q = start; q != p; q++) {
+      int delta = *q - previous;
+      w.vle((uint32_t)((delta << 1) ^ (delta >> 31))); // zigzag
+      previous = *q;
+    }
+  }
+  w.flush();
+}
+
+bool decodeRVL(const uchar *data, size_t size, Mat &depth)
+{
+  if (size < rvlHeaderSize || getU32(data) != rvlMagic) return false;
+  uint32_t rows = getU32(data + 4), cols = getU32(data + 8);
+  if (rows > 0xffff || cols > 0xffff) return false;
+  depth.create(rows, cols, CV_16UC1);
+
+  NibbleReader r(data + rvlHeaderSize, data + size);
+  ushort *p = depth.ptr<ushort>(), *end = p + depth.total();
+  int previous = 0;
+  while (p != end)
+  {
+    uint32_t zeros, nonzeros;
+    if (!r.vle(zeros) || zeros > (size_t)(end - p)) return false;
+    std::fill(p, p + zeros, 0);
+    p += zeros;
+    if (!r.vle(nonzeros) || nonzeros > (size_t)(end - p)) return false;
+    for (uint32_t i = 0; i < nonzeros; i++) {
+      uint32_t zigzag;
+      if (!r.vle(zigzag)) return false;
+      previous += (int)(zigzag >> 1) ^ -(int)(zigzag & 1);
+      *p++ = (ushort)previous;
+    }
+  }
+  return true;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+void encode(const Mat &depth, Encoding encoding, vector<uchar> &out)
+{
+  Mat mm;
+  cvhelper::depthToMillimeters(depth, mm);
+  switch (encoding)
+  {
+    case rvl: encodeRVL(mm, out); return;
+    case png: {
+      static const vector<int> params{CV_IMWRITE_PNG_COMPRESSION, 1};
+      cv::imencode(".png", mm, out, params);
+      return;
+    }
+    case jpeg: {
+      // JPEG cannot store 16 bits, converted here rather than by imencode
+      static const vector<int> params{CV_IMWRITE_JPEG_QUALITY, 75};
+      Mat eightBit;
+      mm.convertTo(eightBit, CV_8U);
+      cv::imencode(".jpg", eightBit, out, params);
+      return;
+    }
+  }
+}
+
+}
+}
@@ -0,0 +1,43 @@
+#ifndef DEPTH_CODEC_H_
+#define DEPTH_CODEC_H_
+
+/*
+Lossless encodings for depth frames (CV_16UC1, millimetres) that go to
+clients. JPEG, as for color frames, keeps 8 bits and cuts off everything
+beyond 255mm.
+
+RVL (Wilson, "Fast Lossless Depth Image Compression", 2017) is made for
+depth sensors: runs of invalid (0) pixels are counted, valid pixels are
+stored as zigzag deltas to the previous one, all as variable length codes
+of 3 bit nibbles. It compresses about as well as PNG at a fraction of the
+cost. A record is:
+
+  u32 magic "RVL1" (0x314c5652), u32 rows, u32 cols,
+  then u32 words of eight nibbles each, the first one in the high bits
+
+all little-endian.
+*/
+
+#include <opencv2/opencv.hpp>
+
+namespace vision {
+namespace depth {
+
+enum Encoding { jpeg, png, rvl };
+
+const uint32_t rvlMagic = 0x314c5652; // "RVL1"
+const size_t rvlHeaderSize = 12;
+
+void encodeRVL(const cv::Mat &depth, std::vector<uchar> &out);
+// false if data is not an RVL record or ends early
+bool decodeRVL(const uchar *data, size_t size, cv::Mat &depth);
+
+// depth in millimetres (float depth is converted) as encoding. png is 16
+// bit and compressed fast rather than small. jpeg is lossy: 8 bit, depth
+// beyond 255mm saturates, as in PreviewEncoder
+void encode(const cv::Mat &depth, Encoding encoding, std::vector<uchar> &out);
+
+}
+}
+
+#endif  // DEPTH_CODEC_H_
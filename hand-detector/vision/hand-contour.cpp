@@ -0,0 +1,273 @@
+#include "vision/hand-contour.hpp"
+#include <algorithm>
+
+namespace vision {
+namespace hand {
+
+using namespace cv;
+
+using PointV = vector<Point>;
+
+// Contour as structure of arrays. Candidates are analyzed in parallel, each
+// thread keeps its own buffers between frames.
+struct ContourScratch
+{
+  vector<int> xs, ys;
+  PointV selected;
+};
+
+static thread_local ContourScratch scratch;
+
+// Palm radius and center from the points around the tip, shared by both
+// versions so that they only differ in how they get there
+static void fillHandContour(
+  const PointV &pointsNearCenter,
+  Point armStart, Point pointingToP,
+  HandContour &handContour)
+{
+  auto boundsAroundHand = minAreaRect(pointsNearCenter);
+
+  Point2f to = Point2f(pointingToP.x, pointingToP.y);
+
+  int fingerRadius = max(boundsAroundHand.size.width, boundsAroundHand.size.height)/2;
+  Point palmCenter = boundsAroundHand.center + (to - boundsAroundHand.center)*.5;
+
+  handContour.bounds = boundsAroundHand;
+  handContour.contourPoints = pointsNearCenter;
+  handContour.armStart = armStart;
+  handContour.pointTowards = pointingToP;
+  handContour.fingerRadius = fingerRadius;
+  handContour.palmCenter = palmCenter;
+}
+
+// We assume that the hands "width" is around 1/3 of its "length". Mabe more
+// with outstretched fingers?
+static float palmReach(const RotatedRect &contourBounds)
+{
+  float longSide = std::max(contourBounds.size.width, contourBounds.size.height),
+        shortSide = std::min(contourBounds.size.width, contourBounds.size.height),
+        ratio = (shortSide / longSide);
+  return ratio > 0.3 ? longSide : shortSide * 1.6;
+}
+
+bool findHandContour(
+  const PointV &contourPoints,
+  const RotatedRect &contourBounds,
+  const Rect &fullImageBounds,
+  const TableSpace &table,
+  HandContour &handContour)
+{
+  size_t n = contourPoints.size();
+  vector<int> &xs = scratch.xs, &ys = scratch.ys;
+  PointV &selected = scratch.selected;
+  xs.resize(n); ys.resize(n);
+  selected.clear();
+
+  // 1. copy the contour and pick the points on the table's edge, this is
+  // where the arm starts. For the image rect one unsigned compare per axis
+  // tests both sides: x-offset wraps around when x < offset.
+  if (table.empty()) {
+    int innerW = std::max(0, fullImageBounds.width-2*edgeOffset),
+        innerH = std::max(0, fullImageBounds.height-2*edgeOffset);
+    for (size_t i = 0; i < n; i++) {
+      int x = contourPoints[i].x, y = contourPoints[i].y;
+      xs[i] = x; ys[i] = y;
+      bool inside = ((unsigned)(x - edgeOffset) < (unsigned)innerW)
+                  & ((unsigned)(y - edgeOffset) < (unsigned)innerH);
+      if (!inside) selected.push_back(contourPoints[i]);
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      int x = contourPoints[i].x, y = contourPoints[i].y;
+      xs[i] = x; ys[i] = y;
+      if (pointPolygonTest(table.outline, Point2f(x, y), true) < edgeOffset)
+        selected.push_back(contourPoints[i]);
+    }
+  }
+
+  if (selected.empty()) return false;
+
+  // 2. the opposite end to the arm start
+  Point armStart = minAreaRect(selected).center,
+        pointingToP = armStart;
+  long maxDist = 0;
+  size_t farthest = n;
+  for (size_t i = 0; i < n; i++) {
+    long dx = xs[i] - armStart.x, dy = ys[i] - armStart.y,
+         dist = dx*dx + dy*dy;
+    if (dist > maxDist) { farthest = i; maxDist = dist; }
+  }
+  if (farthest < n) pointingToP = Point(xs[farthest], ys[farthest]);
+
+  // 3. the contour points around it
+  double reach = palmReach(contourBounds), reach2 = reach * reach;
+  PointV pointsNearCenter;
+  pointsNearCenter.reserve(n);
+  for (size_t i = 0; i < n; i++) {
+    long dx = xs[i] - pointingToP.x, dy = ys[i] - pointingToP.y;
+    if (dx*dx + dy*dy <= reach2) pointsNearCenter.push_back(Point(xs[i], ys[i]));
+  }
+
+  fillHandContour(pointsNearCenter, armStart, pointingToP, handContour);
+  return true;
+}
+
+bool findHandContourReference(
+  const PointV &contourPoints,
+  const RotatedRect &contourBounds,
+  const Rect &fullImageBounds,
+  const TableSpace &table,
+  HandContour &handContour)
+{
+  // find which contour points are on the table's edge. This is where the arm
+  // starts
+  int offset = edgeOffset;
+  Rect innerRect(offset, offset, fullImageBounds.width-2*offset, fullImageBounds.height-2*offset);
+  
+  PointV pointsOnEdge;
+  for (auto p : contourPoints) {
+    bool onEdge = table.empty()
+      ? !innerRect.contains(p)
+      : pointPolygonTest(table.outline, Point2f(p.x, p.y), true) < offset;
+    if (onEdge) pointsOnEdge.push_back(p);
+  }
+
+  if (pointsOnEdge.size() == 0) return false;
+
+  // find the opposite end to the arm start
+  Point armStart = minAreaRect(pointsOnEdge).center,
+        pointingToP = armStart;
+  int maxDist = 0;
+  for (auto p : contourPoints)
+  {
+    int dist = norm(p - armStart);
+    if (dist > maxDist) { pointingToP = p; maxDist = dist; }
+  }
+
+  float longSideShortened = palmReach(contourBounds);
+
+  PointV pointsNearCenter;
+  for (auto p : contourPoints)
+    if (norm(pointingToP - p) <= longSideShortened)
+      pointsNearCenter.push_back(p);
+
+  fillHandContour(pointsNearCenter, armStart, pointingToP, handContour);
+  return true;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// finger tips
+
+struct Peak
+{
+  int sample;
+  double sharpness; // cos² of the angle at the sample
+};
+
+struct TipScratch
+{
+  PointV samples;
+  vector<Peak> peaks;
+};
+
+static thread_local TipScratch tipScratch;
+
+static inline long sqDist(const Point &a, const Point &b)
+{
+  long dx = a.x - b.x, dy = a.y - b.y;
+  return dx*dx + dy*dy;
+}
+
+// A point every step pixels along the closed contour. findContours leaves
+// out the points of straight runs, k samples have to mean the same length
+// everywhere.
+static void resample(const PointV &contour, int step, PointV &samples)
+{
+  samples.clear();
+  float next = 0; // where the next sample goes on the current segment
+  for (size_t i = 0; i < contour.size(); i++) {
+    Point2f a = contour[i], d = Point2f(contour[(i+1) % contour.size()]) - a;
+    float len = std::sqrt(d.dot(d));
+    for (; next < len; next += step) samples.push_back(a + d * (next / len));
+    next -= len;
+  }
+}
+
+void findFingerTips(
+  const PointV &contour,
+  const HandContour &hand,
+  const Options &opts,
+  vector<Finger> &fingers)
+{
+  fingers.clear();
+  PointV &s = tipScratch.samples;
+  vector<Peak> &peaks = tipScratch.peaks;
+  peaks.clear();
+  resample(contour, std::max(1, opts.fingerTipStep), s);
+  int n = s.size(), k = opts.fingerTipK;
+  if (k < 1 || n <= 2*k || opts.maxFingerTips <= 0) return;
+
+  // tips bend the same way the outline goes around
+  long area2 = 0;
+  for (int i = 0; i < n; i++) {
+    const Point &a = s[i], &b = s[(i+1) % n];
+    area2 += (long)a.x*b.y - (long)b.x*a.y;
+  }
+  int orientation = area2 > 0 ? 1 : -1;
+
+  double maxCos = std::max(0.0, std::cos(opts.fingerTipMaxAngle * CV_PI / 180)),
+         maxCos2 = maxCos * maxCos;
+  // a finger reaches farther from the arm than the palm center
+  long palmDist = sqDist(hand.palmCenter, hand.armStart);
+
+  // one sweep, a run of sharp samples is one peak at its sharpest sample
+  bool inRun = false;
+  Peak best{0, 0};
+  for (int i = 0; i < n; i++)
+  {
+    const Point &p = s[i], &a = s[(i - k + n) % n], &b = s[(i + k) % n];
+    long ax = a.x - p.x, ay = a.y - p.y, bx = b.x - p.x, by = b.y - p.y,
+         dot = ax*bx + ay*by, cross = bx*ay - by*ax;
+    double la = ax*ax + ay*ay, lb = bx*bx + by*by,
+           sharpness = dot > 0 && la > 0 && lb > 0 ? (double)dot*dot / (la*lb) : 0;
+    bool sharp = sharpness > maxCos2
+              && cross * orientation > 0
+              && sqDist(p, hand.armStart) > palmDist;
+    if (sharp) {
+      if (!inRun || sharpness > best.sharpness) best = Peak{i, sharpness};
+      inRun = true;
+    } else if (inRun) {
+      peaks.push_back(best);
+      inRun = false;
+    }
+  }
+  if (inRun) peaks.push_back(best);
+
+  // non-maximum suppression. Peaks are in contour order, close peaks are
+  // neighbours, including the last and the first one
+  long minDist2 = (long)opts.fingerTipWidth * opts.fingerTipWidth;
+  size_t kept = 0;
+  for (size_t i = 0; i < peaks.size(); i++) {
+    if (kept > 0 && sqDist(s[peaks[kept-1].sample], s[peaks[i].sample]) < minDist2) {
+      if (peaks[i].sharpness > peaks[kept-1].sharpness) peaks[kept-1] = peaks[i];
+    } else peaks[kept++] = peaks[i];
+  }
+  peaks.resize(kept);
+  if (peaks.size() > 1 && sqDist(s[peaks.front().sample], s[peaks.back().sample]) < minDist2) {
+    if (peaks.back().sharpness > peaks.front().sharpness) peaks.front() = peaks.back();
+    peaks.pop_back();
+  }
+
+  // more than a hand has: drop the bluntest
+  while (peaks.size() > (size_t)opts.maxFingerTips)
+    peaks.erase(std::min_element(peaks.begin(), peaks.end(),
+      [](const Peak &a, const Peak &b) { return a.sharpness < b.sharpness; }));
+
+  for (auto &peak : peaks) {
+    int i = peak.sample;
+    fingers.push_back(Finger{s[(i - k + n) % n], s[(i + k) % n], s[i], 0});
+  }
+}
+
+} // hand
+} // vision
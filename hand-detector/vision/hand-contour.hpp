@@ -0,0 +1,54 @@
+#ifndef HAND_CONTOUR_H_
+#define HAND_CONTOUR_H_
+
+/*
+Finds the part of a contour that is the hand: where the arm enters the
+table, the point farthest away from there and the contour points around it.
+This runs for every candidate of every frame, so the contour is copied once
+into plain x / y arrays and all distance tests compare squared distances,
+no square roots per point.
+
+Finger tips are found with k-curvature on the evenly resampled contour: one
+sweep tests the angle at every sample, runs of sharp samples collapse to
+their sharpest one and tips closer than fingerTipWidth are merged. Linear in
+the contour length, no hull, no sorting.
+*/
+
+#include "vision/hand-detection.hpp"
+
+namespace vision {
+namespace hand {
+
+// how close to the edge of the image / table a contour has to get to count
+// as coming from outside
+const int edgeOffset = 5;
+
+bool findHandContour(
+  const std::vector<cv::Point> &contourPoints,
+  const cv::RotatedRect &contourBounds,
+  const cv::Rect &fullImageBounds,
+  const TableSpace &table,
+  HandContour &handContour);
+
+// The straightforward version findHandContour started from, one pass with
+// norm() per step. Kept to compare against in hand-detector-bench.
+bool findHandContourReference(
+  const std::vector<cv::Point> &contourPoints,
+  const cv::RotatedRect &contourBounds,
+  const cv::Rect &fullImageBounds,
+  const TableSpace &table,
+  HandContour &handContour);
+
+// Up to opts.maxFingerTips tips of contour (the whole contour, hand is its
+// findHandContour result) in contour order. base1 / base2 are the samples
+// fingerTipK before and after the tip, z is left to the caller.
+void findFingerTips(
+  const std::vector<cv::Point> &contour,
+  const HandContour &hand,
+  const Options &opts,
+  std::vector<Finger> &fingers);
+
+}
+}
+
+#endif  // HAND_CONTOUR_H_
@@ -0,0 +1,77 @@
+#include "vision/hand-detection.hpp"
+
+namespace vision {
+namespace hand {
+
+// Little-endian no matter the host, byte by byte
+class BinaryWriter
+{
+  public:
+    BinaryWriter(std::vector<uchar> &out) : out(out) {};
+    void u8(uint8_t v) { out.push_back(v); }
+    void u16(uint16_t v) { u8(v & 0xff); u8(v >> 8); }
+    void u32(uint32_t v) { u16(v & 0xffff); u16(v >> 16); }
+    void i16(int v) { u16((uint16_t)cv::saturate_cast<short>(v)); }
+    void i16(float v) { i16(cvRound(v)); }
+    void i32(int32_t v) { u32((uint32_t)v); }
+    void i64(int64_t v) { u32((uint32_t)((uint64_t)v & 0xffffffff)); u32((uint32_t)((uint64_t)v >> 32)); }
+    void point(const cv::Point &p) { i16(p.x); i16(p.y); }
+
+  private:
+    std::vector<uchar> &out;
+};
+
+/*
+Header, 20 bytes:
+  u32 magic "HAND" (0x444e4148), u16 version, u16 number of hands,
+  i64 time, i16 image width, i16 image height
+Per hand, 22 bytes:
+  i32 id, i16 palm radius, i16 x2 palm center,
+  i16 x2 contour bounds center, i16 x2 size, i16 angle in 1/10 degree,
+  u8 number of finger tips, u8 reserved
+Per finger tip, 14 bytes:
+  i16 x2 base1, i16 x2 base2, i16 x2 tip, i16 z
+base1 / base2 are contour points on either side of the tip, see Finger.
+Coordinates are rounded, values outside of int16 are clamped.
+*/
+void frameWithHandsToBinary(const FrameWithHands &data, std::vector<uchar> &out)
+{
+  size_t size = handEventHeaderSize;
+  for (auto &hand : data.hands) size += 22 + 14 * std::min<size_t>(hand.fingerTips.size(), 255);
+  out.clear();
+  out.reserve(size);
+
+  BinaryWriter w(out);
+  w.u32(handEventMagic);
+  w.u16(handEventVersion);
+  w.u16(std::min<size_t>(data.hands.size(), 0xffff));
+  w.i64(data.time);
+  w.i16(data.imageSize.width);
+  w.i16(data.imageSize.height);
+
+  for (size_t h = 0; h < data.hands.size() && h < 0xffff; h++)
+  {
+    const HandData &hand = data.hands[h];
+    size_t nTips = std::min<size_t>(hand.fingerTips.size(), 255);
+    w.i32(hand.id);
+    w.i16(hand.palmRadius);
+    w.point(hand.palmCenter);
+    w.i16(hand.contourBounds.center.x);
+    w.i16(hand.contourBounds.center.y);
+    w.i16(hand.contourBounds.size.width);
+    w.i16(hand.contourBounds.size.height);
+    w.i16(hand.contourBounds.angle * 10);
+    w.u8(nTips);
+    w.u8(0);
+    for (size_t i = 0; i < nTips; i++) {
+      const Finger &f = hand.fingerTips[i];
+      w.point(f.base1);
+      w.point(f.base2);
+      w.point(f.tip);
+      w.i16(f.z);
+    }
+  }
+}
+
+}
+}
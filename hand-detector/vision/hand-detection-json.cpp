@@ -1,5 +1,7 @@
 #include "vision/hand-detection.hpp"
 #include "json/json.h"
+#include <cmath>
+#include <cstdio>
 
 namespace vision {
 namespace hand {
@@ -35,26 +37,29 @@ Json::Value convert(Finger data) {
   return json;
 }
 
-Json::Value convert(HandData data) {
+Json::Value convert(const HandData &data, const HandFields &fields = HandFields()) {
   Json::Value json;
-  json["palmRadius"] = data.palmRadius;
-  json["palmCenter"] = convert(data.palmCenter);
-  json["contourBounds"] = convert(data.contourBounds);
-  json["fingerTips"] = {};
-  for (int i = 0; i < data.fingerTips.size(); i++) {
-    json["fingerTips"][i] = convert(data.fingerTips[i]);
+  if (fields.id || data.id != 0) json["id"] = data.id;
+  if (fields.palmRadius) json["palmRadius"] = data.palmRadius;
+  if (fields.palmCenter) json["palmCenter"] = convert(data.palmCenter);
+  if (fields.contourBounds) json["contourBounds"] = convert(data.contourBounds);
+  if (fields.fingerTips) {
+    json["fingerTips"] = {};
+    for (int i = 0; i < data.fingerTips.size(); i++) {
+      json["fingerTips"][i] = convert(data.fingerTips[i]);
+    }
   }
   // json["convexityDefectArea"] = data.convexityDefectArea;
   // json["fingerTips"] = data.fingerTips;
   return json;
 }
 
-Json::Value convert(FrameWithHands data) {
+Json::Value convert(const FrameWithHands &data, const HandFields &fields = HandFields()) {
   Json::Value json;
   json["time"] = (long long)data.time;
   json["imageSize"] = convert(data.imageSize);
   for (int i = 0; i < data.hands.size(); i++) {
-    json["hands"][i] = convert(data.hands[i]);
+    json["hands"][i] = convert(data.hands[i], fields);
   }
   return json;
 }
@@ -63,9 +68,117 @@ Json::Value frameWithHandsToJSON(FrameWithHands &data) {
   return convert(data);
 }
 
+Json::Value frameWithHandsToJSON(FrameWithHands &data, const HandFields &fields) {
+  return convert(data, fields);
+}
+
 std::string frameWithHandsToJSONString(FrameWithHands &data) {
-  Json::FastWriter writer;
-  return writer.write(convert(data));
+  std::string out;
+  writeFrameWithHandsJSON(data, out);
+  return out;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// What Json::FastWriter (jsoncpp 1.9) makes of convert(FrameWithHands) with
+// all fields, byte for byte, written directly. Keys come in the order of the
+// Value's map, alphabetical. Numbers are converted like the convert
+// functions above do.
+
+class JSONWriter
+{
+  public:
+    JSONWriter(std::string &out) : out(out) {};
+
+    JSONWriter& raw(const char *s) { out += s; return *this; }
+
+    JSONWriter& integer(long long v)
+    {
+      char buf[24], *end = buf + sizeof(buf), *p = end;
+      unsigned long long u = v < 0 ? 0ull - (unsigned long long)v : v;
+      do { *--p = '0' + u % 10; u /= 10; } while (u);
+      if (v < 0) *--p = '-';
+      out.append(p, end - p);
+      return *this;
+    }
+
+    // as Json::valueToString(double)
+    JSONWriter& real(double v)
+    {
+      if (std::isnan(v)) return raw("null");
+      if (std::isinf(v)) return raw(v < 0 ? "-1e+9999" : "1e+9999");
+      char buf[36];
+      int len = std::snprintf(buf, sizeof(buf), "%.17g", v);
+      bool hasPoint = false;
+      for (int i = 0; i < len; i++) {
+        if (buf[i] == ',') buf[i] = '.'; // locales with decimal comma
+        if (buf[i] == '.' || buf[i] == 'e') hasPoint = true;
+      }
+      out.append(buf, len);
+      if (!hasPoint) out += ".0";
+      return *this;
+    }
+
+    JSONWriter& point(const cv::Point &p)
+    {
+      return raw("{\"x\":").integer(p.x).raw(",\"y\":").integer(p.y).raw("}");
+    }
+
+    JSONWriter& size(const cv::Size &s)
+    {
+      return raw("{\"height\":").integer(s.height).raw(",\"width\":").integer(s.width).raw("}");
+    }
+
+    JSONWriter& rotatedRect(const cv::RotatedRect &r)
+    {
+      return raw("{\"angle\":").real(r.angle)
+            .raw(",\"center\":").point(r.center)
+            .raw(",\"size\":").size(r.size).raw("}");
+    }
+
+    JSONWriter& finger(const Finger &f)
+    {
+      return raw("{\"base1\":").point(f.base1)
+            .raw(",\"base2\":").point(f.base2)
+            .raw(",\"tip\":").point(f.tip)
+            .raw(",\"z\":").integer(f.z).raw("}");
+    }
+
+    JSONWriter& hand(const HandData &h)
+    {
+      raw("{\"contourBounds\":").rotatedRect(h.contourBounds);
+      raw(",\"fingerTips\":");
+      if (h.fingerTips.empty()) raw("null");
+      else {
+        for (size_t i = 0; i < h.fingerTips.size(); i++)
+          raw(i == 0 ? "[" : ",").finger(h.fingerTips[i]);
+        raw("]");
+      }
+      if (h.id != 0) raw(",\"id\":").integer(h.id);
+      return raw(",\"palmCenter\":").point(h.palmCenter)
+            .raw(",\"palmRadius\":").integer(h.palmRadius).raw("}");
+    }
+
+    JSONWriter& frame(const FrameWithHands &f)
+    {
+      // no hands, no "hands" key
+      raw("{");
+      if (!f.hands.empty()) {
+        for (size_t i = 0; i < f.hands.size(); i++)
+          raw(i == 0 ? "\"hands\":[" : ",").hand(f.hands[i]);
+        raw("],");
+      }
+      return raw("\"imageSize\":").size(f.imageSize)
+            .raw(",\"time\":").integer((long long)f.time).raw("}\n");
+    }
+
+  private:
+    std::string &out;
+};
+
+void writeFrameWithHandsJSON(const FrameWithHands &data, std::string &out)
+{
+  out.clear();
+  JSONWriter(out).frame(data);
 }
 
 }
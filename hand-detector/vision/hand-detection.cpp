@@ -1,7 +1,11 @@
 #include "vision/hand-detection.hpp"
 #include "vision/cv-debugging.hpp"
+#include "vision/blobs.hpp"
+#include "vision/hand-contour.hpp"
 #include <numeric>
 #include <algorithm>
+#include <climits>
+#include <sstream>
 
 bool debug = false;
 #define dbg \
@@ -31,15 +35,6 @@ PointType meanPos(vector<PointType> points)
   return c;
 }
 
-struct ConvexityDefect
-{
-  Point onHullStart;  // point of the contour where the defect begins
-  Point onHullEnd;    // point of the contour where the defect ends
-  Point defect;       // the farthest from the convex hull point within the defect
-  float distFromHull; // distance between the farthest point and the convex hull
-  float distFromCenter;
-};
-
 Mat prepareForContourDetection(Mat &src, Options opts)
 {
 
@@ -94,89 +89,29 @@ Mat prepareForContourDetection(Mat &src, Options opts)
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
-bool findHandContour(
-  const PointV &contourPoints,
-  const RotatedRect &contourBounds,
-  const Rect &fullImageBounds,
-  HandContour &handContour)
+bool onTable(const Point2f &p, const Rect &fullImageBounds, const TableSpace &table)
 {
-  // find which contour points are on the image's edge. This is where the arm
-  // starts
-  int offset = 5;
-  Rect innerRect(offset, offset, fullImageBounds.width-2*offset, fullImageBounds.height-2*offset);
-  
-  PointV pointsOnEdge;
-  for (auto p : contourPoints) {
-    if (!innerRect.contains(p))
-      pointsOnEdge.push_back(p);
-  }
-
-  if (pointsOnEdge.size() == 0) return false;
-
-  // find the opposite end to the arm start
-  Point armStart = minAreaRect(pointsOnEdge).center,
-        pointingToP = armStart;
-  int maxDist = 0;
-  for (auto p : contourPoints)
-  {
-    int dist = norm(p - armStart);
-    if (dist > maxDist) { pointingToP = p; maxDist = dist; }
-  }
-
-  // find the bounding box around the palm area. We assume that the hands
-  // "width" is around 1/3 of its "length". Mabe more with outstretched fingers?
-  float longSide = std::max(contourBounds.size.width, contourBounds.size.height),
-        shortSide = std::min(contourBounds.size.width, contourBounds.size.height),
-        ratio = (shortSide / longSide),
-        longSideShortened = ratio > 0.3 ? longSide : shortSide * 1.6;
-
-  PointV pointsNearCenter;
-  for (auto p : contourPoints)
-    if (norm(pointingToP - p) <= longSideShortened)
-      pointsNearCenter.push_back(p);
-
-  auto boundsAroundHand = minAreaRect(pointsNearCenter);
-  
-  Point2f to = Point2f(pointingToP.x, pointingToP.y);
-
-  int fingerRadius = max(boundsAroundHand.size.width, boundsAroundHand.size.height)/2;
-  Point palmCenter = boundsAroundHand.center + (to - boundsAroundHand.center)*.5;
-
-  handContour.bounds = boundsAroundHand;
-  handContour.contourPoints = pointsNearCenter;
-  handContour.armStart = armStart;
-  handContour.pointTowards = pointingToP;
-  handContour.fingerRadius = fingerRadius;
-  handContour.palmCenter = palmCenter;
-  
-  return true;
+  if (!table.empty()) return pointPolygonTest(table.outline, p, false) >= 0;
+  return !(p.x < 0 || p.x > fullImageBounds.width
+        || p.y < 0 || p.y > fullImageBounds.height);
 }
 
-void contourHullExtraction(
-    PointV &contours,
-    PointV &hullPoints,
-    vector<int> &hullInts, vector<Vec4i> &defects)
+bool touchesEdge(const Rect &bounds, const Rect &fullImageBounds, const TableSpace &table)
 {
-    convexHull(contours, hullPoints);
-    convexHull(contours, hullInts);
-    if (hullPoints.size() >= 3)
-      convexityDefects(contours, hullInts, defects);
-}
-
-bool contourMoments(PointV &contours, vector<Moments> &momentsVec)
-{
-    Moments mo = moments(contours, false);
-    if (mo.m00 > 0) { // self intersecting...
-        // Point pos = Point((int) (mo.m10 / mo.m00), (int) (mo.m01 / mo.m00));
-        // std::cout
-        //     << "Moments: [" << i << "] "
-        //     << mo.m10 << "/" << mo.m00 << " = " << pos.x << ","
-        //     << mo.m01 << "/" << mo.m00 << " = " << pos.y
-        //     << std::endl;
-        momentsVec.push_back(mo);
-        return true;
-    }
-    return false;
+  // The test findHandContour does for every contour point, done for the
+  // corners of a blob's bounds. Image and table outline are (close to)
+  // convex: if the corners keep away from the edge, all in between does too.
+  Rect innerRect(edgeOffset, edgeOffset, fullImageBounds.width-2*edgeOffset, fullImageBounds.height-2*edgeOffset);
+  Point corners[] = {
+    bounds.tl(), Point(bounds.br().x-1, bounds.y),
+    bounds.br() - Point(1,1), Point(bounds.x, bounds.br().y-1)};
+  for (auto p : corners) {
+    bool onEdge = table.empty()
+      ? !innerRect.contains(p)
+      : pointPolygonTest(table.outline, Point2f(p.x, p.y), true) < edgeOffset;
+    if (onEdge) return true;
+  }
+  return false;
 }
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -190,274 +125,359 @@ void drawRect(Mat &drawing, Scalar color, RotatedRect rect)
   line(drawing, pts[3], pts[0], color, 6);
 }
 
-void drawHull(Mat &drawing, Scalar color, PointV &hullPoints)
+template<typename Mean>
+int maxOfWindows(const Rect &r, Mean mean)
 {
-    for (auto hullp : hullPoints) {
-        circle(drawing, hullp,   4, Scalar(255,255,0), 2 );
-    }
+  // four quarters and one in the middle
+  auto w2 = r.width/2, h2 = r.height/2;
+  return std::max({
+                  mean(Rect(r.x,        r.y,        w2, h2)),
+                  mean(Rect(r.x + w2,   r.y,        w2, h2)),
+                  mean(Rect(r.x + w2,   r.y + h2,   w2, h2)),
+                  mean(Rect(r.x,        r.y + h2,   w2, h2)),
+                  mean(Rect(r.x + w2/2, r.y + h2/2, w2, h2))});
 }
 
-void drawMoments(Mat &drawing, const Scalar color, const vector<Moments> &momentsVec)
+template<typename T>
+double summedMean(const Mat &sums, const Rect &r)
 {
-    const Moments mo = momentsVec.back();
-    Point pos = Point((int) (mo.m10 / mo.m00), (int) (mo.m01 / mo.m00));
-    circle(drawing, pos, 10, color, 5);
+  if (r.area() <= 0) return 0;
+  double s = (double)sums.at<T>(r.y + r.height, r.x + r.width)
+           - sums.at<T>(r.y,            r.x + r.width)
+           - sums.at<T>(r.y + r.height, r.x)
+           + sums.at<T>(r.y,            r.x);
+  return s / r.area();
 }
 
-vector<ConvexityDefect> convexityDefects(
-    Mat &drawing,
-    const HandContour c,
-    const vector<Vec4i> &defects)
+// cv::integral takes 8 bit or float images only, we sum 16 bit depth
+template<typename S>
+void summedArea(const Mat &diff, Mat &sums)
 {
-    vector<ConvexityDefect> result;
-
-    for (Vec4i d : defects) {
-        int startidx = d[0], endidx = d[1], faridx = d[2];
-        Point defect(c.contourPoints[faridx]);// the farthest from the convex hull point within the defect
-        // if (norm(defect-c.palmCenter) > c.fingerRadius) continue;
-        Point onHullStart(c.contourPoints[startidx]); // point of the contour where the defect begins
-        Point onHullEnd(c.contourPoints[endidx]); // point of the contour where the defect ends
-        float distFromHull = d[3] / 256; // distance between the farthest point and the convex hull
-        // if (distFromHull > 20)
-        {
-          // std::cout << norm(defect - palmCenter) << " vs " << palmRadius << std::endl;
-            // if (norm(defect - palmCenter) < palmRadius) {
-                ConvexityDefect data {
-                  onHullStart,                 // onHullStart
-                  onHullEnd,                   // onHullEnd
-                  defect,                      // defect
-                  distFromHull,                // distFromHull
-                  (float)norm(defect - c.palmCenter) // distFromCenter
-                };
-                result.push_back(data);
-            // }
-
-        }
+  sums.create(diff.rows + 1, diff.cols + 1, DataType<S>::type);
+  sums.row(0).setTo(Scalar(0));
+  for (int y = 0; y < diff.rows; y++)
+  {
+    const ushort *d = diff.ptr<ushort>(y);
+    const S *above = sums.ptr<S>(y);
+    S *s = sums.ptr<S>(y + 1), row = 0;
+    s[0] = 0;
+    for (int x = 0; x < diff.cols; x++) {
+      row += d[x];
+      s[x + 1] = above[x + 1] + row;
     }
+  }
+}
 
-    return result;
+Rect DepthSampler::window(const Point &tablePoint) const
+{
+  // depth might still be in camera space, find where the point came from
+  Point p = tablePoint;
+  if (!depthLookup.empty()) {
+    auto src = depthLookup.at<Vec2s>(
+      std::min(depthLookup.rows-1, std::max(p.y, 0)),
+      std::min(depthLookup.cols-1, std::max(p.x, 0)));
+    p = Point(src[0], src[1]);
+  }
+
+  auto x = std::min(depth.cols-1, std::max(p.x-l, 0)),
+       y = std::min(depth.rows-1, std::max(p.y-l, 0)),
+       w = 2*l, h = 2*l;
+  if (x + w > depth.cols) w = depth.cols-x;
+  if (y + h > depth.rows) h = depth.rows-y;
+  return Rect(x, y, w, h);
 }
 
-void drawConvexityDefects(
-    Mat &drawing,
-    const Scalar color,
-    const vector<ConvexityDefect> &defects)
+int DepthSampler::at(const Point &tablePoint) const
 {
-    for (auto d : defects) {
-      // line(drawing, ptStart, ptEnd, CV_RGB(255,0,0), 2 );
-      line(drawing, d.onHullStart, d.defect, CV_RGB(0,0,255), 6);
-      line(drawing, d.onHullEnd, d.defect, CV_RGB(0,0,255), 6);
-      Point mid = (d.onHullStart+d.onHullEnd)*.5;
-      line(drawing, mid, d.defect, CV_RGB(255,0,0), 2 );
-      // line(drawing, onHullEnd, defect, color, 2 );
-      // circle(drawing, onHullStart,   4, Scalar(100,0,255), 2 );
-      circle(drawing, d.defect,   15, CV_RGB(255,0,0), 5 );
-    }
+  Rect r = window(tablePoint);
+  Mat diff;
+  absdiff(Mat(depth, r), Mat(depthBackground, r), diff);
+  return maxOfWindows(Rect(Point(), r.size()), [&diff](const Rect &q) {
+    return q.area() > 0 ? cv::mean(Mat(diff, q))[0] : 0.0;
+  });
 }
 
-vector<Finger> findFingerTips(
-    const vector<ConvexityDefect> &defects,
-    const PointV &hullPoints,
-    const Rect innerBounds,
-    Options opts)
+void DepthSampler::sample(vector<Finger> &fingers) const
 {
-  // Guess 1: if angle from defect point to the two connecting hull points is
-  // sharp it is probably a finger
-  // Guess 2: if we have one finger tip (hull point) that is close or equal to
-  // another finger tip and the lines to their defects are nearly parallel, we
-  // have another (pointing) finger
+  if (fingers.empty()) return;
+  vector<Rect> windows;
+  long windowArea = 0;
+  for (auto &f : fingers) {
+    windows.push_back(window(f.tip));
+    windowArea += windows.back().area();
+  }
+  Rect covered = windows[0];
+  for (auto &w : windows) covered |= w;
+
+  // summing pays off only when the windows overlap enough. It is done for
+  // 16 bit depth, the millimetres the server works with
+  if (windowArea <= covered.area() || depth.depth() != CV_16U) {
+    for (auto &f : fingers) f.z = at(f.tip);
+    return;
+  }
 
-  Mat debug(innerBounds.size(), CV_8UC3);
-  auto color = cvhelper::randomColor();
+  // 16 bit diffs fit into 32 bit sums for up to 32768 pixels, a hand's
+  // worth. Bigger regions get double sums.
+  Mat diff, sums;
+  absdiff(Mat(depth, covered), Mat(depthBackground, covered), diff);
+  bool wide = covered.area() > INT_MAX / USHRT_MAX;
+  if (wide) summedArea<double>(diff, sums);
+  else summedArea<int>(diff, sums);
+  for (size_t i = 0; i < fingers.size(); i++) {
+    Rect r = windows[i] - covered.tl();
+    fingers[i].z = wide
+      ? maxOfWindows(r, [&sums](const Rect &q) { return summedMean<double>(sums, q); })
+      : maxOfWindows(r, [&sums](const Rect &q) { return summedMean<int>(sums, q); });
+  }
+}
 
-  if (defects.empty()) return vector<Finger>();
+HandData handDataToTable(const HandData &hand, const TableSpace &table, Size frameSize)
+{
+  // Everything but the outline of a hand is a point or rectangle, so
+  // instead of projecting the frames we can project just these
+  vector<Point2f> pts, tfmed;
+  Point2f bounds[4], defectArea[4];
+  hand.contourBounds.points(bounds);
+  hand.convexityDefectArea.points(defectArea);
+  pts.push_back(hand.palmCenter);
+  pts.push_back(Point2f(hand.palmCenter.x + hand.palmRadius, hand.palmCenter.y));
+  pts.push_back(Point2f(hand.palmCenter.x, hand.palmCenter.y + hand.palmRadius));
+  pts.insert(pts.end(), bounds, bounds+4);
+  pts.insert(pts.end(), defectArea, defectArea+4);
+  for (auto f : hand.fingerTips) {
+    pts.push_back(f.base1); pts.push_back(f.base2); pts.push_back(f.tip);
+  }
 
-  for (int i = 1; i < defects.size(); i++)
-  {
-    auto d1 = defects[i], d2 = defects[i-1];
-    line(debug, d1.onHullStart, d2.defect, CV_RGB(255,100,0), 3);
-    line(debug, d1.onHullStart, d1.defect, CV_RGB(100,255,0), 3);
-    if (norm(d1.onHullEnd - d2.onHullStart) > opts.fingerTipWidth)
-    {
-      d2.onHullStart = d1.onHullEnd;
-    }
+  if (table.cameraSize.area() > 0) {
+    for (auto &p : pts) p += Point2f(table.cropOrigin);
+    frameSize = table.cameraSize;
+  }
+  warp::transformPoints(pts, tfmed, table.projection, frameSize, table.lens);
+
+  HandData result = hand;
+  result.palmCenter = tfmed[0];
+  // under perspective the palm circle becomes an ellipse, the radius is that
+  // of a circle with its area
+  result.palmRadius = std::round(std::sqrt(std::abs((tfmed[1] - tfmed[0]).cross(tfmed[2] - tfmed[0]))));
+  // the projection of a rectangle is not necessarily one anymore, take the
+  // closest match
+  result.contourBounds = minAreaRect(vector<Point2f>(tfmed.begin()+3, tfmed.begin()+7));
+  result.convexityDefectArea = minAreaRect(vector<Point2f>(tfmed.begin()+7, tfmed.begin()+11));
+  for (size_t i = 0; i < result.fingerTips.size(); i++) {
+    result.fingerTips[i].base1 = tfmed[11 + i*3];
+    result.fingerTips[i].base2 = tfmed[11 + i*3 + 1];
+    result.fingerTips[i].tip   = tfmed[11 + i*3 + 2];
+  }
+  return result;
+}
+
+// What we know about a contour after looking at it
+struct Candidate
+{
+  bool isHand = false;
+  HandData hand;
+  Rect bounds; // of the contour, in frame coordinates
+  HandContour handContour;
+  std::string log;
+};
+
+void analyzeCandidate(
+  const PointV &contour,
+  const Rect &imageBounds,
+  const TableSpace &table,
+  long minArea,
+  const Options &opts,
+  const DepthSampler &depthSampler,
+  Candidate &candidate)
+{
+  // runs on a worker thread, collect debug output instead of printing it
+  std::ostringstream log;
+
+  double area = std::abs(contourArea(contour, true));
+  if (debug) log << ": " << contour.size() << "/" << area;
+
+  if (contour.size() < 5) {
+    if (debug) log << "  dismissing it b/c size!";
+    candidate.log = log.str();
+    return;
+  }
+  if (area < minArea) {
+    if (debug) log << "  dismissing it b/c min area!";
+    candidate.log = log.str();
+    return;
   }
 
-  // for (int i = 0; i < defects.size(); i++)
-  // {
-  //   Point before = i > 0 ? defects[i-1].onHullEnd : Point(0,0);
-  //   Point after = i < defects.size()-2 ? defects[i+1].onHullStart : Point(0,0);
-  // }
-  // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
-  vector<ConvexityDefect> defectsCopy(defects.size());
-  std::rotate_copy(defects.begin(), defects.begin()+1, defects.end(), defectsCopy.begin());
-  vector<Finger> result;
-
-  auto it2 = defectsCopy.begin();
-  for (auto it = defects.begin(); it != defects.end(); it++, it2++) {
-    // std::cout << norm(it->onHullStart - it2->onHullEnd) << "...." << norm(it->onHullEnd - it2->onHullStart) << std::endl;
-    if (norm(it->onHullStart - it2->onHullEnd) < opts.fingerTipWidth)
-    {
-      Point mid = it->onHullStart + (it2->onHullEnd - it->onHullStart) * .5;        
-      Finger f{it->defect, it2->defect, mid};
-      if (cvhelper::radToDeg(f.angle()) < 89) result.push_back(f);
-    }
-    if (norm(it->onHullEnd - it2->onHullStart) < opts.fingerTipWidth)
+  RotatedRect fullContourBounds = fitEllipse(contour);
+  if (!onTable(fullContourBounds.center, imageBounds, table)) {
+    if (debug) log << "  dismissing it b/c outside of bounds!";
+    candidate.log = log.str();
+    return;
+  }
+
+  HandContour &handContour = candidate.handContour;
+  bool success = findHandContour(contour, fullContourBounds, imageBounds, table, handContour);
+  if (!success) {
+    if (debug) log << "  dismissing it b/c no hand contour found!";
+    candidate.log = log.str();
+    return;
+  }
+
+  vector<Finger> fingers;
+  findFingerTips(contour, handContour, opts, fingers);
+
+  depthSampler.sample(fingers);
+  if (debug) for (auto &finger : fingers) log << "\n  found finger: " << finger;
+
+  candidate.isHand = true;
+  candidate.bounds = boundingRect(contour);
+  candidate.hand = HandData{
+    handContour.fingerRadius, handContour.palmCenter,
+    fullContourBounds, handContour.bounds,
+    fingers
+  };
+  candidate.log = log.str();
+}
+
+// Every contour is looked at independently, each one writes only into its
+// own Candidate
+class CandidateAnalysis : public ParallelLoopBody
+{
+  public:
+    CandidateAnalysis(
+      const vector<PointV> &contours, const Rect &imageBounds,
+      const TableSpace &table, long minArea, const Options &opts,
+      const DepthSampler &depthSampler, vector<Candidate> &candidates)
+      : contours(contours), imageBounds(imageBounds), table(table),
+        minArea(minArea), opts(opts), depthSampler(depthSampler), candidates(candidates) {};
+
+    void operator()(const Range &range) const
     {
-      Point mid = it->onHullEnd + (it2->onHullStart - it->onHullEnd) * .5;        
-      Finger f{it->defect, it2->defect, mid};
-      if (cvhelper::radToDeg(f.angle()) < 89) result.push_back(f);
+      for (int i = range.start; i < range.end; i++)
+        analyzeCandidate(contours[i], imageBounds, table, minArea, opts, depthSampler, candidates[i]);
     }
+
+  private:
+    const vector<PointV> &contours;
+    const Rect &imageBounds;
+    const TableSpace &table;
+    long minArea;
+    const Options &opts;
+    const DepthSampler &depthSampler;
+    vector<Candidate> &candidates;
+};
+
+void drawCandidate(Mat &debugImage, const vector<PointV> &contours, int i, const Candidate &candidate)
+{
+  auto color = cvhelper::randomColor();
+  const HandContour &handContour = candidate.handContour;
+  drawContours(debugImage, contours, i, color, 2, 8);
+
+  drawRect(debugImage, CV_RGB(0,255,0), handContour.bounds);
+  circle(debugImage, handContour.pointTowards, 10, CV_RGB(255,255,255), 3);
+
+  // ellipse(debugImage, cBounds, CV_RGB(255,0,0), 2, 8 );
+  // ellipse(debugImage, defectBounds, CV_RGB(0,255,0), 3, 8 );
+  circle(debugImage, handContour.palmCenter, handContour.fingerRadius, CV_RGB(0,0,255), 3, 8 );
+
+  for (auto f : candidate.hand.fingerTips) {
+    line(debugImage, f.base1, f.tip, CV_RGB(0, 255,0), 3);
+    line(debugImage, f.base2, f.tip, CV_RGB(0, 255,0), 3);
+    circle(debugImage, f.tip,   15, CV_RGB(255,0,0), 4);
   }
-  // std::cout << result.size() << std::endl;
+}
 
-  return result;
+long minHandArea(const Rect &imageBounds, const TableSpace &table, const Options &opts)
+{
+  long tableArea = table.empty() ? imageBounds.width * imageBounds.height : contourArea(table.outline);
+  return (tableArea / 100) * opts.minHandAreaInPercent;
 }
 
-int depthAtPoint(Point &p, const Mat &depth, const Mat &depthBackground, Options &opts)
+bool traceCandidates(
+  const Mat &diff,
+  const Rect &region,
+  const Rect &imageBounds,
+  const TableSpace &table,
+  long minArea,
+  vector<PointV> &contours)
 {
-  auto l = opts.depthSamplingKernelLength;
+  // Most of the mask is speckles. Blobs come with their area and bounds, so
+  // only those that are big enough and reach the edge (where the arm comes
+  // from) get their contour traced.
+  // Returns false if a blob that might be a hand is cut off by the region's
+  // border, the region is too small then.
+  blobs::Components components;
+  components.label(Mat(diff, region));
+  int dismissedBlobs = 0;
+  for (size_t b = 0; b < components.blobs().size(); b++)
+  {
+    const blobs::Blob &blob = components.blobs()[b];
+    Rect bounds = blob.bounds + region.tl();
+    // a blob at a border of the region that is not a border of the image
+    // continues outside of it. Speckles don't matter.
+    bool cutOff =
+         (bounds.x == region.x && region.x > 0)
+      || (bounds.y == region.y && region.y > 0)
+      || (bounds.br().x == region.br().x && region.br().x < imageBounds.width)
+      || (bounds.br().y == region.br().y && region.br().y < imageBounds.height);
+    if (cutOff && blob.area >= minArea / 4) return false;
+    if (blob.area < minArea || !touchesEdge(bounds, imageBounds, table)) {
+      dismissedBlobs++;
+      continue;
+    }
+    Mat blobMask;
+    components.render(b, blobMask);
+    vector<PointV> traced;
+    cv::findContours(blobMask, traced, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_TC89_L1, bounds.tl() - Point(1,1));
+    contours.insert(contours.end(), traced.begin(), traced.end());
+  }
 
-  auto x = std::min(depth.cols-1, std::max(p.x-l, 0)),
-       y = std::min(depth.rows-1, std::max(p.y-l, 0)),
-       w = 2*l, h = 2*l;
-  if (x + w > depth.cols) w = depth.cols-x;
-  if (y + h > depth.rows) h = depth.rows-y;
-  auto w2 = std::floor(w/2.0f),
-       h2 = std::floor(h/2.0f);
-
-  Rect bounds = Rect(x,y,w,h);
-  
-  Mat depthRoi = Mat(depth, bounds);
-  Mat depthBgRoi = Mat(depthBackground, bounds);
-
-// std::cout << depthRoi.size() << " vs " << depthBgRoi.size() << std::endl;
-  // return 0;
-  Mat diff(depthRoi.size(), CV_32F);
-  absdiff(depthRoi, depthBgRoi, diff);
-// std::cout << diff.size() << " vs " << w2 << "," << h2 << std::endl;
-  
-  return std::max({
-    // mean(depthRoi)[0],
-                  mean(Mat(diff, Rect(0,    0,    w2, h2)))[0],
-                  mean(Mat(diff, Rect(w2,   0,    w2, h2)))[0],
-                  mean(Mat(diff, Rect(w2,   h2,   w2, h2)))[0],
-                  mean(Mat(diff, Rect(0,    h2,   w2, h2)))[0],
-                  mean(Mat(diff, Rect(w2/2, h2/2, w2, h2)))[0]});
+  dbg << "Region " << region << ": " << components.blobs().size() << " blobs, "
+      << dismissedBlobs << " too small or not at the edge" << std::endl;
+  return true;
 }
 
-vector<HandData> findContours(
+bool findContours(
   const Mat &src,
   const Mat &depth,
   const Mat &depthBackground,
+  const Mat &depthLookup,
+  const TableSpace &table,
   const Mat &diff,
   Mat &debugImage,
-  Options &opts)
+  Options &opts,
+  const vector<Rect> &regions,
+  vector<HandData> &result,
+  vector<Rect> &handBounds)
 {
-  vector<HandData> result;
-  vector<Vec4i> hierarchy;
-  vector<PointV > contours;
-  findContours(diff, contours, hierarchy, CV_RETR_TREE, CV_CHAIN_APPROX_TC89_L1, Point(0, 0));
-  vector<PointV> hullsP (contours.size());
-  vector<cv::vector<int>> hullsI(contours.size());
-  vector<vector<Vec4i> > defects(contours.size());
-  vector<vector<Moments>> momentsVec(contours.size());
-  Rect imageBounds = Rect(0,0, src.cols, src.rows);
-  long minArea = ((imageBounds.width * imageBounds.height) / 100) * opts.minHandAreaInPercent;
+  // Only looks at regions of diff. False if they were not big enough for
+  // the hands in them
+  Rect imageBounds = Rect(0,0, diff.cols, diff.rows);
+  long minArea = minHandArea(imageBounds, table, opts);
+  DepthSampler depthSampler(depth, depthBackground, depthLookup, opts);
 
-  dbg << "Found " << contours.size() << " contours" << std::endl;
-  /// Draw contours
-  for (int i = 0; i< contours.size(); i++)
-  {
-      double area = std::abs(contourArea(contours[i], true));
-      dbg << "\ncontour " << i << ": " << contours[i].size() << "/" << area;
+  vector<PointV> contours;
+  for (auto &region : regions)
+    if (!traceCandidates(diff, region, imageBounds, table, minArea, contours))
+      return false;
 
-      if (contours[i].size() < 5) {
-        dbg << "  dismissing it b/c size!";
-        continue;
-      }
-      if (area < minArea) {
-        dbg << "  dismissing it b/c min area!";
-        continue;
-      }
-      
-
-      RotatedRect fullContourBounds = fitEllipse(contours[i]);
-      if (fullContourBounds.center.x < 0
-       || fullContourBounds.center.x > imageBounds.width
-       || fullContourBounds.center.y < 0
-       || fullContourBounds.center.y > imageBounds.height) {
-        dbg << "  dismissing it b/c outside of bounds!";
-         continue;
-       }
-
-      HandContour handContour;
-      bool success = findHandContour(contours[i], fullContourBounds, imageBounds, handContour);
-      if (!success) {
-        dbg << "  dismissing it b/c no hand contour found!";
-        continue;
-      }
+  dbg << "Found " << contours.size() << " contours" << std::endl;
 
-      contourHullExtraction(handContour.contourPoints, hullsP[i], hullsI[i], defects[i]);
-
-      bool momentsFound = contourMoments(contours[i], momentsVec[i]);
-      vector<ConvexityDefect> defectData = convexityDefects(debugImage, handContour, defects[i]);
-      // vector<Finger> fingers = findFingerTips(defectData, hullsP[i], innerImageBounds);
-
-      // FIXME!!!
-      vector<Finger> fingers{};
-      if (defectData.size() >= 2)
-      {
-        sort(defectData.begin(), defectData.end(),
-          [&](ConvexityDefect a, ConvexityDefect b){
-            return norm(a.defect - handContour.pointTowards)
-                 < norm(b.defect - handContour.pointTowards);
-          });
-          
-        auto z = depthAtPoint(handContour.pointTowards, depth, depthBackground, opts);
-
-        auto finger = Finger{
-          defectData[0].defect,
-          defectData[1].defect,
-          handContour.pointTowards, z};
-        dbg << "\n  found finger: " << finger;
-        fingers.push_back(finger);
-      }
+  // With several people at the table there are plenty of hands. They are
+  // analyzed in parallel, results (and debug output) are collected in
+  // contour order afterwards so that the output does not depend on
+  // scheduling.
+  vector<Candidate> candidates(contours.size());
+  parallel_for_(Range(0, contours.size()),
+    CandidateAnalysis(contours, imageBounds, table, minArea, opts, depthSampler, candidates));
 
-      result.push_back(HandData{
-        handContour.fingerRadius, handContour.palmCenter,
-        fullContourBounds, handContour.bounds,
-        fingers
-      });
-
-
-      if (opts.renderDebugImages) {
-        auto color = cvhelper::randomColor();
-        drawContours(debugImage, contours, i, color, 2, 8, hierarchy, 0, Point());
-
-        drawRect(debugImage, CV_RGB(0,255,0), handContour.bounds);
-        circle(debugImage, handContour.pointTowards, 10, CV_RGB(255,255,255), 3);
-
-        // drawContours(debugImage, hullsP, i, color, 1, 8, vector<Vec4i>(), 0, Point());
-        // drawHull(debugImage, color, hullsP[i]);
-        // if (momentsFound) drawMoments(debugImage, color, momentsVec[i]);
-        // ellipse(debugImage, cBounds, CV_RGB(255,0,0), 2, 8 );
-        // ellipse(debugImage, defectBounds, CV_RGB(0,255,0), 3, 8 );
-        circle(debugImage, handContour.palmCenter, handContour.fingerRadius, CV_RGB(0,0,255), 3, 8 );
-
-        for (auto d : defectData)
-        {
-          // circle(debugImage, d.defect, 7, CV_RGB(255,255,0), 2);
-          // circle(debugImage, d.onHullStart, 7, CV_RGB(255,100,0), 4);
-          // circle(debugImage, d.onHullEnd, 7, CV_RGB(100,255,0), 4);
-        }
-        // drawConvexityDefects(debugImage, color, defectData);
-        for (auto f : fingers) {
-          line(debugImage, f.base1, f.tip, CV_RGB(0, 255,0), 3);
-          line(debugImage, f.base2, f.tip, CV_RGB(0, 255,0), 3);
-          circle(debugImage, f.tip,   15, CV_RGB(255,0,0), 4);
-        }
-      }
+  for (int i = 0; i < candidates.size(); i++)
+  {
+    const Candidate &candidate = candidates[i];
+    dbg << "\ncontour " << i << candidate.log;
+    if (!candidate.isHand) continue;
+    result.push_back(candidate.hand);
+    handBounds.push_back(candidate.bounds);
+    if (opts.renderDebugImages) drawCandidate(debugImage, contours, i, candidate);
   }
 
   if (opts.renderDebugImages) {
@@ -466,21 +486,297 @@ vector<HandData> findContours(
     // cv::addWeighted(contourImg, 0.5f, debugImage, 0.5f, 0.0f, contourImg);
   }
 
-  return result;
+  return true;
 }
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
 
+Mat tableMaskFor(Size size, const TableSpace &table)
+{
+  Mat tableMask = Mat::zeros(size, CV_8UC1);
+  vector<PointV> outlines{table.outline};
+  fillPoly(tableMask, outlines, Scalar(255));
+  return tableMask;
+}
+
+bool detectHands(
+  Mat &src,
+  Mat &depth, Mat &depthBackground, Mat &depthDiffSmooth, Mat &depthDiffMask,
+  FrameWithHands &handsFound, Options &opts,
+  const Mat &depthLookup,
+  const TableSpace &table,
+  const Mat &tableMask,
+  const vector<Rect> &regions,
+  vector<Rect> &handBounds,
+  vector<HandData> &frameHands)
+{
+  // frameHands: what handsFound.hands were before they were moved onto the
+  // table
+  // only what is on the table is of interest
+  if (!table.empty()) {
+    if (opts.renderDebugImages) {
+      bitwise_and(depthDiffMask, tableMask, depthDiffMask);
+    } else {
+      for (auto &r : regions) {
+        Mat maskRegion(depthDiffMask, r);
+        bitwise_and(maskRegion, Mat(tableMask, r), maskRegion);
+      }
+    }
+  }
+
+  Mat debugImage;
+  if (opts.renderDebugImages) {
+    debugImage = src.clone();
+    depthDiffSmooth.copyTo(debugImage, depthDiffMask);
+  }
+  vector<HandData> hands;
+  if (!findContours(src, depth, depthBackground, depthLookup, table, depthDiffMask, debugImage, opts, regions, hands, handBounds))
+    return false;
+  frameHands = hands;
+
+  if (table.empty()) {
+    handsFound = FrameWithHands {std::time(nullptr), src.size(), hands};
+  } else {
+    for (auto &hand : hands) hand = handDataToTable(hand, table, depthDiffMask.size());
+    handsFound = FrameWithHands {std::time(nullptr), table.tableSize, hands};
+  }
+  return true;
+}
+
+Options inFramePixels(Options opts, const TableSpace &table)
+{
+  // The pixel options are meant for table pixels. Frames that are not
+  // projected show the table at another resolution, scale them to it.
+  double scale = std::sqrt(contourArea(table.outline) / std::max(1, table.tableSize.area()));
+  auto scaled = [scale](int px) { return px > 0 ? std::max(1, (int)std::round(px * scale)) : px; };
+  opts.fingerTipWidth = scaled(opts.fingerTipWidth);
+  opts.fingerTipStep = scaled(opts.fingerTipStep);
+  opts.depthSamplingKernelLength = scaled(opts.depthSamplingKernelLength);
+  opts.cropWidth = scaled(opts.cropWidth);
+  opts.trackingMargin = scaled(opts.trackingMargin);
+  opts.tileSize = scaled(opts.tileSize);
+  return opts;
+}
+
 void processFrame(
   Mat &src,
   Mat &depth, Mat &depthBackground, Mat &depthDiffSmooth, Mat &depthDiffMask,
-  FrameWithHands &handsFound, Options opts)
+  FrameWithHands &handsFound, Options opts,
+  const Mat &depthLookup,
+  const TableSpace &table)
+{
+  debug = opts.debug;
+  if (!table.empty()) opts = inFramePixels(opts, table);
+  Mat tableMask;
+  if (!table.empty()) tableMask = tableMaskFor(depthDiffMask.size(), table);
+  vector<Rect> everything{Rect(Point(), depthDiffMask.size())}, handBounds;
+  vector<HandData> frameHands;
+  detectHands(
+    src, depth, depthBackground, depthDiffSmooth, depthDiffMask,
+    handsFound, opts, depthLookup, table, tableMask, everything, handBounds, frameHands);
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// HandDetector
+
+const int coarseScale = 4;
+
+void mergeOverlapping(vector<Rect> &regions)
+{
+  regions.erase(
+    std::remove_if(regions.begin(), regions.end(), [](const Rect &r) { return r.area() == 0; }),
+    regions.end());
+  for (size_t i = 0; i < regions.size(); i++)
+    for (size_t j = i + 1; j < regions.size(); j++)
+      if ((regions[i] & regions[j]).area() > 0) {
+        regions[i] |= regions[j];
+        regions.erase(regions.begin() + j);
+        j = i; // the grown region might overlap earlier ones now
+      }
+}
+
+vector<Rect> HandDetector::trackedRegions(const Rect &imageBounds, const Options &opts)
+{
+  // where the hands of the last frame are plus where they are heading,
+  // assuming they keep moving like between the last two frames
+  vector<Rect> regions;
+  int m = opts.trackingMargin;
+  for (auto &b : bounds)
+  {
+    Point center = (b.tl() + b.br()) * 0.5, motion;
+    double closest = std::max(b.width, b.height);
+    for (auto &prev : previousBounds) {
+      Point prevCenter = (prev.tl() + prev.br()) * 0.5;
+      double dist = norm(center - prevCenter);
+      if (dist < closest) { closest = dist; motion = center - prevCenter; }
+    }
+    Rect predicted = b | (b + motion);
+    regions.push_back(Rect(predicted.x - m, predicted.y - m, predicted.width + 2*m, predicted.height + 2*m) & imageBounds);
+  }
+  return regions;
+}
+
+vector<Rect> HandDetector::coarseScan(const Mat &mask, const Rect &imageBounds, const TableSpace &table, const Options &opts)
+{
+  // A look at every coarseScale-th pixel of the mask to find hands that
+  // just came in
+  Mat coarse;
+  resize(mask, coarse, Size(), 1.0/coarseScale, 1.0/coarseScale, INTER_NEAREST);
+  if (!table.empty()) {
+    if (coarseTableMask.size() != coarse.size())
+      resize(tableMask, coarseTableMask, coarse.size(), 0, 0, INTER_NEAREST);
+    bitwise_and(coarse, coarseTableMask, coarse);
+  }
+
+  // be generous, the real checks happen on the full resolution mask
+  long minArea = minHandArea(imageBounds, table, opts) / (2 * coarseScale * coarseScale);
+  int m = opts.trackingMargin;
+  blobs::Components components;
+  components.label(coarse);
+  vector<Rect> regions;
+  for (auto &blob : components.blobs()) {
+    if (blob.area < minArea) continue;
+    Rect r = blob.bounds;
+    regions.push_back(Rect(
+      r.x*coarseScale - m, r.y*coarseScale - m,
+      r.width*coarseScale + 2*m, r.height*coarseScale + 2*m) & imageBounds);
+  }
+  return regions;
+}
+
+void HandDetector::countTiles(const Mat &mask, const vector<Rect> &regions, const Options &opts)
+{
+  // the signature of a tile is the number of mask pixels in it. Only the
+  // tiles of the regions we might skip are counted.
+  int t = opts.tileSize;
+  Size tiles((mask.cols + t - 1) / t, (mask.rows + t - 1) / t);
+  if (referenceCounts.size() != tiles) referenceCounts = Mat(tiles, CV_32S, Scalar(-1));
+  tileCounts = Mat(tiles, CV_32S, Scalar(-1));
+  Rect imageBounds(Point(), mask.size());
+  for (auto &r : regions)
+    for (int y = r.y / t; y <= (r.br().y - 1) / t; y++)
+      for (int x = r.x / t; x <= (r.br().x - 1) / t; x++)
+        if (tileCounts.at<int>(y, x) < 0)
+          tileCounts.at<int>(y, x) = countNonZero(Mat(mask, Rect(x*t, y*t, t, t) & imageBounds));
+}
+
+bool HandDetector::tilesUnchanged(const Rect &region, const Options &opts)
+{
+  // compared to when the hand in region was analyzed last
+  int t = opts.tileSize;
+  for (int y = region.y / t; y <= (region.br().y - 1) / t; y++)
+    for (int x = region.x / t; x <= (region.br().x - 1) / t; x++) {
+      int now = tileCounts.at<int>(y, x), then = referenceCounts.at<int>(y, x);
+      if (now < 0 || then < 0 || std::abs(now - then) > opts.tileChangeTolerance) return false;
+    }
+  return true;
+}
+
+void HandDetector::keepTileCounts(const Rect &region, const Options &opts)
+{
+  int t = opts.tileSize;
+  for (int y = region.y / t; y <= (region.br().y - 1) / t; y++)
+    for (int x = region.x / t; x <= (region.br().x - 1) / t; x++)
+      referenceCounts.at<int>(y, x) = tileCounts.at<int>(y, x);
+}
+
+void HandDetector::processFrame(
+  Mat &src,
+  Mat &depth, Mat &depthBackground, Mat &depthDiffSmooth, Mat &depthDiffMask,
+  FrameWithHands &handsFound, Options opts,
+  const Mat &depthLookup,
+  const TableSpace &table)
 {
   debug = opts.debug;
-  Mat debugImage = src.clone();
-  depthDiffSmooth.copyTo(debugImage, depthDiffMask);
-  vector<HandData> hands = findContours(src, depth, depthBackground, depthDiffMask, debugImage, opts);
-  handsFound = FrameWithHands {std::time(nullptr), src.size(), hands};
+  if (!table.empty()) opts = inFramePixels(opts, table);
+  Rect imageBounds(Point(), depthDiffMask.size());
+
+  if (depthDiffMask.size() != frameSize) {
+    // a different stream as far as we are concerned
+    frameSize = depthDiffMask.size();
+    bounds.clear(); previousBounds.clear();
+    frameHands.clear();
+    referenceCounts = Mat();
+    frameCount = 0;
+    tableOutline.clear();
+  }
+  if (table.outline != tableOutline) {
+    tableOutline = table.outline;
+    tableMask = table.empty() ? Mat() : tableMaskFor(frameSize, table);
+    coarseTableMask = Mat();
+  }
+
+  // one region per hand of the last frame. Hands whose tiles did not change
+  // since they were analyzed (e.g. resting on the table) are taken as they
+  // are, only their depth is sampled again.
+  vector<Rect> tracked = trackedRegions(imageBounds, opts);
+  vector<bool> resting(tracked.size(), false);
+  if (opts.tileSize > 0) {
+    countTiles(depthDiffMask, tracked, opts);
+    for (size_t i = 0; i < tracked.size(); i++)
+      resting[i] = tilesUnchanged(tracked[i], opts);
+  }
+
+  vector<Rect> regions;
+  for (size_t i = 0; i < tracked.size(); i++)
+    if (!resting[i]) regions.push_back(tracked[i]);
+  if (bounds.empty() || opts.fullScanInterval <= 1 || frameCount % opts.fullScanInterval == 0) {
+    // new hands, not the resting ones again
+    for (auto &r : coarseScan(depthDiffMask, imageBounds, table, opts)) {
+      bool known = false;
+      for (size_t i = 0; i < tracked.size(); i++)
+        known = known || (resting[i] && (r & tracked[i]) == r);
+      if (!known) regions.push_back(r);
+    }
+  }
+  // a resting hand in the way of a region that is searched anyway is
+  // searched again, otherwise we would find it twice
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t i = 0; i < tracked.size(); i++) {
+      if (!resting[i]) continue;
+      for (auto &r : regions)
+        if ((r & tracked[i]).area() > 0) { resting[i] = false; changed = true; break; }
+      if (!resting[i]) regions.push_back(tracked[i]);
+    }
+  }
+  mergeOverlapping(regions);
+  frameCount++;
+
+  vector<Rect> handBounds;
+  vector<HandData> newFrameHands;
+  if (!detectHands(
+      src, depth, depthBackground, depthDiffSmooth, depthDiffMask,
+      handsFound, opts, depthLookup, table, tableMask, regions, handBounds, newFrameHands)) {
+    dbg << "a hand outgrew its region, looking at everything" << std::endl;
+    handBounds.clear();
+    resting.assign(resting.size(), false);
+    regions = {imageBounds};
+    if (opts.tileSize > 0) countTiles(depthDiffMask, regions, opts);
+    detectHands(
+      src, depth, depthBackground, depthDiffSmooth, depthDiffMask,
+      handsFound, opts, depthLookup, table, tableMask, regions, handBounds, newFrameHands);
+  }
+  if (opts.tileSize > 0)
+    for (auto &r : regions) keepTileCounts(r, opts);
+
+  vector<HandData> newHands = handsFound.hands;
+  DepthSampler depthSampler(depth, depthBackground, depthLookup, opts);
+  for (size_t i = 0; i < tracked.size(); i++)
+  {
+    if (!resting[i]) continue;
+    dbg << "hand " << i << " is resting" << std::endl;
+    HandData hand = frameHands[i];
+    depthSampler.sample(hand.fingerTips);
+    newFrameHands.push_back(hand);
+    newHands.push_back(table.empty() ? hand : handDataToTable(hand, table, frameSize));
+    handBounds.push_back(bounds[i]);
+  }
+  handsFound.hands = newHands;
+
+  previousBounds = bounds;
+  bounds = handBounds;
+  frameHands = newFrameHands;
 }
 
 } // hand
@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <opencv2/opencv.hpp>
 #include "vision/cv-helper.hpp"
+#include "vision/warp-maps.hpp"
 #include "json/forwards.h"
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
@@ -12,6 +13,13 @@
 namespace vision {
 namespace hand {
 
+enum class ProjectionMode
+{
+  warpFrames, // warp depth and background into table space, then diff
+  warpMask,   // diff and threshold in camera space, warp only the mask
+  points      // detect in camera space, project only the results
+};
+
 struct Options
 {
   // How far apart can convexity defect hull points lay apart to still be
@@ -19,6 +27,14 @@ struct Options
   bool debug = false;
   bool renderDebugImages = true;
   int fingerTipWidth = 50;
+  // Finger tips: the contour is resampled every fingerTipStep pixels. A
+  // sample is a tip where the contour turns sharper than fingerTipMaxAngle
+  // degrees (at most 90) between the samples fingerTipK before and after it.
+  // Tips closer than fingerTipWidth are one tip.
+  int fingerTipStep = 6;
+  int fingerTipK = 5;
+  float fingerTipMaxAngle = 60;
+  int maxFingerTips = 5;
   float minHandAreaInPercent = 2.0f;
   int depthSamplingKernelLength = 10;
   int blurIntensity = 11;
@@ -27,6 +43,16 @@ struct Options
   int thresholdType = CV_THRESH_BINARY_INV;
   int dilateIterations = 5;
   int cropWidth = 12;
+  ProjectionMode projectionMode = ProjectionMode::warpFrames;
+  // HandDetector: how many pixels around a hand are searched in the next
+  // frame and every how many frames the whole mask is checked for new hands
+  int trackingMargin = 40;
+  int fullScanInterval = 10;
+  // HandDetector: the mask is split into tiles of tileSize pixels. A hand
+  // whose tiles changed by at most tileChangeTolerance mask pixels is not
+  // analyzed again. 0 turns that off.
+  int tileSize = 32;
+  int tileChangeTolerance = 8;
 };
 
 struct HandContour
@@ -39,6 +65,10 @@ struct HandContour
   cv::Point palmCenter;
 };
 
+// base1 / base2 are the contour points fingerTipK samples (of fingerTipStep
+// pixels) before and after the tip, on either side of the finger. They used
+// to be convexity defects between the fingers, clients should not expect them
+// to be between two fingers any more.
 struct Finger
 {
   cv::Point base1;
@@ -64,6 +94,22 @@ struct HandData
   cv::RotatedRect contourBounds;
   cv::RotatedRect convexityDefectArea; // the subset of the contourBounds that we consider for defects
   std::vector<Finger> fingerTips;
+  int id; // same hand, same id across frames (HandTracker), 0 = untracked
+};
+
+// Where the table is in the frames handed to processFrame. Empty means the
+// frames were projected already and the table is the whole image.
+struct TableSpace
+{
+  std::vector<cv::Point> outline; // table border in frame coordinates
+  cv::Mat projection;             // frame -> table
+  warp::Lens lens;
+  cv::Size tableSize;
+  // when the frames are a crop of the camera image: where the crop starts and
+  // the size of the whole image, projection and lens refer to that
+  cv::Point cropOrigin;
+  cv::Size cameraSize;
+  bool empty() const { return outline.empty(); };
 };
 
 struct FrameWithHands {
@@ -72,11 +118,87 @@ struct FrameWithHands {
   std::vector<HandData> hands;
 };
 
-void processFrame(cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, FrameWithHands&, Options);
+// How far above the background finger tips are: the largest mean
+// |depth - background| of five windows around each tip. depthLookup as for
+// processFrame. sample looks at all tips of a hand at once: when their
+// windows overlap it sums the part of the frame they cover once (an integral
+// image) instead of every window on its own. at samples one point.
+class DepthSampler
+{
+  public:
+    DepthSampler(const cv::Mat &depth, const cv::Mat &depthBackground, const cv::Mat &depthLookup, const Options &opts)
+      : depth(depth), depthBackground(depthBackground), depthLookup(depthLookup),
+        l(opts.depthSamplingKernelLength) {};
+    void sample(std::vector<Finger> &fingers) const;
+    int at(const cv::Point &tablePoint) const;
+
+  private:
+    cv::Rect window(const cv::Point &tablePoint) const; // in depth coordinates
+    const cv::Mat &depth, &depthBackground, &depthLookup;
+    int l;
+};
+
+// depthLookup is for depth that was not projected: a CV_16SC2 lookup from
+// table to depth coordinates (warp::Maps::xyNearest). With a TableSpace the
+// frames are not projected at all, hands are found in camera space and then
+// moved onto the table. Pixel options still count table pixels, they are
+// scaled by how large the table is in the frames.
+void processFrame(cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, FrameWithHands&, Options, const cv::Mat &depthLookup = cv::Mat(), const TableSpace& = TableSpace());
+
+// processFrame for the frames of a stream. Hands move only a few pixels from
+// one frame to the next, so only the regions around last frame's hands
+// (moved along with them) are searched. A coarse scan of the whole mask
+// finds new hands, every fullScanInterval frames or while no hand is
+// tracked. If a hand outgrows its region the whole frame is searched.
+// Hands that did not change since the last frame are not analyzed again.
+class HandDetector
+{
+  public:
+    void processFrame(cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, cv::Mat&, FrameWithHands&, Options, const cv::Mat &depthLookup = cv::Mat(), const TableSpace& = TableSpace());
+
+  private:
+    std::vector<cv::Rect> trackedRegions(const cv::Rect &imageBounds, const Options&);
+    std::vector<cv::Rect> coarseScan(const cv::Mat &mask, const cv::Rect &imageBounds, const TableSpace&, const Options&);
+    void countTiles(const cv::Mat &mask, const std::vector<cv::Rect> &regions, const Options&);
+    bool tilesUnchanged(const cv::Rect &region, const Options&);
+    void keepTileCounts(const cv::Rect &region, const Options&);
+
+    cv::Size frameSize;
+    long frameCount = 0;
+    std::vector<cv::Rect> bounds, previousBounds; // of the hands found, frame coordinates
+    std::vector<HandData> frameHands;             // before they were moved onto the table
+    cv::Mat tileCounts, referenceCounts;          // CV_32S per tile, -1 = not counted
+    std::vector<cv::Point> tableOutline;
+    cv::Mat tableMask, coarseTableMask;
+};
 
 // -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// Which parts of a hand go into its JSON, for clients that need only some.
+// Tracked hands (id != 0) always have their id.
+struct HandFields
+{
+  bool id = false;
+  bool palmRadius = true;
+  bool palmCenter = true;
+  bool contourBounds = true;
+  bool fingerTips = true;
+  // equal for equal selections
+  int key() const { return id | palmRadius << 1 | palmCenter << 2 | contourBounds << 3 | fingerTips << 4; };
+};
+
 Json::Value frameWithHandsToJSON(FrameWithHands &data);
+Json::Value frameWithHandsToJSON(FrameWithHands &data, const HandFields &fields);
 std::string frameWithHandsToJSONString(FrameWithHands &data);
+// The string frameWithHandsToJSONString returns, written into out (cleared
+// first, its capacity is reused) without building a Json::Value
+void writeFrameWithHandsJSON(const FrameWithHands &data, std::string &out);
+
+// The same as a compact binary record for clients that ask for it, see
+// hand-detection-binary.cpp for the layout. Clients check magic and version.
+const uint32_t handEventMagic = 0x444e4148; // "HAND"
+const uint16_t handEventVersion = 1;
+const size_t handEventHeaderSize = 20;
+void frameWithHandsToBinary(const FrameWithHands &data, std::vector<uchar> &out);
 
 }
 }
@@ -0,0 +1,112 @@
+#include "vision/hand-tracking.hpp"
+#include <algorithm>
+#include <tuple>
+
+namespace vision {
+namespace hand {
+
+using cv::Point;
+using std::vector;
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// One-Euro filter
+
+double smoothingFactor(double dt, double cutoff)
+{
+  double tau = 1.0 / (2 * CV_PI * cutoff);
+  return 1.0 / (1.0 + tau / dt);
+}
+
+double HandTracker::Filter::operator()(double value, double time, const TrackingOptions &opts)
+{
+  if (!initialized) {
+    initialized = true;
+    x = value; dx = 0; t = time;
+    return x;
+  }
+  double dt = time - t;
+  if (dt <= 0) dt = 1.0 / 30;
+  double rawDx = (value - x) / dt;
+  dx += smoothingFactor(dt, opts.derivateCutoff) * (rawDx - dx);
+  double cutoff = opts.minCutoff + opts.beta * std::abs(dx);
+  x += smoothingFactor(dt, cutoff) * (value - x);
+  t = time;
+  return x;
+}
+
+Point HandTracker::PointFilter::operator()(Point p, double time, const TrackingOptions &opts)
+{
+  last = p;
+  double latency = opts.latencyMs / 1000.0,
+         fx = x(p.x, time, opts), fy = y(p.y, time, opts);
+  if (!opts.smooth) return p;
+  // where it will be once the clients get to see it
+  return Point(cvRound(fx + x.dx * latency), cvRound(fy + y.dx * latency));
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+void HandTracker::steady(Track &track, HandData &hand, double time, const TrackingOptions &opts)
+{
+  hand.id = track.id;
+  Point detected = hand.palmCenter;
+  hand.palmCenter = track.palm(hand.palmCenter, time, opts);
+  hand.contourBounds.center += cv::Point2f(hand.palmCenter - detected);
+
+  // fingers come and go, each tip continues the filter of the closest tip
+  // of the last frame
+  vector<PointFilter> tips;
+  vector<bool> taken(track.tips.size(), false);
+  for (auto &finger : hand.fingerTips)
+  {
+    int closest = -1;
+    double closestDist = opts.maxMatchDistance / 2;
+    for (size_t i = 0; i < track.tips.size(); i++) {
+      double dist = cv::norm(track.tips[i].last - finger.tip);
+      if (!taken[i] && dist < closestDist) { closest = i; closestDist = dist; }
+    }
+    PointFilter filter;
+    if (closest >= 0) { taken[closest] = true; filter = track.tips[closest]; }
+    finger.tip = filter(finger.tip, time, opts);
+    tips.push_back(filter);
+  }
+  track.tips = tips;
+}
+
+void HandTracker::update(FrameWithHands &frame, double time, const TrackingOptions &opts)
+{
+  // greedy matching: closest pairs of (track, hand) first
+  vector<std::tuple<double, size_t, size_t>> pairs;
+  for (size_t t = 0; t < tracks.size(); t++)
+    for (size_t h = 0; h < frame.hands.size(); h++) {
+      double dist = cv::norm(tracks[t].palm.last - frame.hands[h].palmCenter);
+      if (dist <= opts.maxMatchDistance) pairs.push_back(std::make_tuple(dist, t, h));
+    }
+  std::sort(pairs.begin(), pairs.end());
+
+  vector<bool> trackMatched(tracks.size(), false), handMatched(frame.hands.size(), false);
+  for (auto &pair : pairs) {
+    size_t t = std::get<1>(pair), h = std::get<2>(pair);
+    if (trackMatched[t] || handMatched[h]) continue;
+    trackMatched[t] = handMatched[h] = true;
+    tracks[t].missed = 0;
+    steady(tracks[t], frame.hands[h], time, opts);
+  }
+
+  // hands we have not seen before
+  vector<Track> kept;
+  for (size_t t = 0; t < tracks.size(); t++)
+    if (trackMatched[t] || ++tracks[t].missed <= opts.maxMissedFrames)
+      kept.push_back(tracks[t]);
+  for (size_t h = 0; h < frame.hands.size(); h++) {
+    if (handMatched[h]) continue;
+    Track track;
+    track.id = nextId++;
+    steady(track, frame.hands[h], time, opts);
+    kept.push_back(track);
+  }
+  tracks = kept;
+}
+
+} // hand
+} // vision
@@ -0,0 +1,70 @@
+#ifndef HAND_TRACKING_H_
+#define HAND_TRACKING_H_
+
+/*
+Gives the hands of consecutive frames an identity and steadies them.
+Hands are matched greedily by the distance of their palm centers, matched
+hands keep their id. Palm center and finger tips go through One-Euro filters
+(Casiez et al. 2012): heavy smoothing while a hand rests, little while it
+moves fast. The filter's velocity estimate is also used to extrapolate the
+positions by the latency of the pipeline. The contour bounds move along with
+the palm center; their size and angle stay as detected, they are what the
+contour covers in this frame.
+*/
+
+#include "vision/hand-detection.hpp"
+
+namespace vision {
+namespace hand {
+
+struct TrackingOptions
+{
+  float maxMatchDistance = 150; // how far a palm center can move between frames
+  int maxMissedFrames = 5;      // keep a hand that was not found this long
+  float minCutoff = 1.0f;       // Hz, smoothing at rest
+  float beta = 0.007f;          // how fast the cutoff grows with speed
+  float derivateCutoff = 1.0f;  // Hz, for the velocity estimate
+  int latencyMs = 0;            // extrapolate positions this far ahead
+  bool smooth = true;           // false: ids only, positions as detected
+};
+
+class HandTracker
+{
+  public:
+    // Sets the ids of frame's hands and smoothes them. time: seconds, when
+    // the frame was taken
+    void update(FrameWithHands &frame, double time, const TrackingOptions &opts = TrackingOptions());
+
+  private:
+    struct Filter
+    {
+      bool initialized = false;
+      double x = 0, dx = 0, t = 0;
+      double operator()(double value, double time, const TrackingOptions&);
+    };
+
+    struct PointFilter
+    {
+      Filter x, y;
+      cv::Point last;
+      cv::Point operator()(cv::Point p, double time, const TrackingOptions&);
+    };
+
+    struct Track
+    {
+      int id;
+      int missed = 0;
+      PointFilter palm;
+      std::vector<PointFilter> tips;
+    };
+
+    void steady(Track &track, HandData &hand, double time, const TrackingOptions&);
+
+    std::vector<Track> tracks;
+    int nextId = 1;
+};
+
+}
+}
+
+#endif  // HAND_TRACKING_H_
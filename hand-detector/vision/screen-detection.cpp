@@ -2,6 +2,7 @@
 #include "vision/quad-transform.hpp"
 #include "vision/cv-helper.hpp"
 #include "vision/cv-debugging.hpp"
+#include "vision/warp-maps.hpp"
 
 #include <numeric>
 #include <algorithm>
@@ -124,8 +125,16 @@ Mat screenProjection(Mat &src, cv::Size size, Options opts, bool debugRecordings
 
 Mat applyScreenProjection(cv::Mat &in, cv::Mat &projection, cv::Size size, Options opts, bool debugRecordings)
 {
-  cv::Mat projected = cv::Mat::zeros(size.width, size.height, in.type());
-  cv::warpPerspective(in, projected, projection, size);
+  return applyScreenProjection(in, projection, in.size(), size, opts, debugRecordings);
+}
+
+Mat applyScreenProjection(cv::Mat &in, cv::Mat &projection, cv::Size projectionInputSize, cv::Size size, Options opts, bool debugRecordings)
+{
+  // projectionInputSize: the frame size the projection was computed for. If
+  // in has a different size it is scaled within the same warp
+  cv::Mat projected;
+  cv::Mat proj = warp::scaledProjection(projection, in.size(), projectionInputSize);
+  cv::warpPerspective(in, projected, proj, size);
   if (debugRecordings) cvdbg::recordImage(projected, "projection");
   return projected;
 }
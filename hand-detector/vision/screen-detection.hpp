@@ -28,6 +28,7 @@ cv::Mat extractLargestRectangle(cv::Mat&, cv::Size, Options, bool = false);
 cv::Mat screenProjection(cv::Mat&, cv::Size, Options, bool = false);
 quad::Corners cornersOfLargestRect(cv::Mat&, Options, bool = false);
 cv::Mat applyScreenProjection(cv::Mat&, cv::Mat&, cv::Size, Options, bool = false);
+cv::Mat applyScreenProjection(cv::Mat&, cv::Mat&, cv::Size, cv::Size, Options, bool = false);
 
 }
 }
@@ -0,0 +1,330 @@
+#include "vision/warp-maps.hpp"
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace vision {
+namespace warp {
+
+using cv::Mat;
+using cv::Size;
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// lens
+
+Mat scaledCameraMatrix(const Lens &lens, Size inputSize)
+{
+  // the calibration might have been done at a different resolution than the
+  // image we are warping, e.g. when the frame was resized before
+  Mat k;
+  lens.cameraMatrix.convertTo(k, CV_64F);
+  if (lens.imageSize.width > 0 && lens.imageSize.height > 0) {
+    double sx = (double)inputSize.width / lens.imageSize.width,
+           sy = (double)inputSize.height / lens.imageSize.height;
+    k.at<double>(0,0) *= sx; k.at<double>(0,1) *= sx; k.at<double>(0,2) *= sx;
+    k.at<double>(1,1) *= sy; k.at<double>(1,2) *= sy;
+  }
+  return k;
+}
+
+void distortPoints(std::vector<cv::Point2f> &points, const Mat &k, const Lens &lens)
+{
+  // points are in the undistorted image. Move them to where these pixels
+  // really are in the (distorted) camera frame.
+  double fx = k.at<double>(0,0), fy = k.at<double>(1,1),
+         cx = k.at<double>(0,2), cy = k.at<double>(1,2);
+  Mat rvec = Mat::zeros(3, 1, CV_64F), tvec = Mat::zeros(3, 1, CV_64F);
+  std::vector<cv::Point3f> rays(points.size());
+  for (size_t i = 0; i < points.size(); i++)
+    rays[i] = cv::Point3f((points[i].x - cx) / fx, (points[i].y - cy) / fy, 1);
+  cv::projectPoints(rays, rvec, tvec, k, lens.distCoeffs, points);
+}
+
+void distortMaps(Mat &mapX, Mat &mapY, const Lens &lens, Size inputSize)
+{
+  Mat k = scaledCameraMatrix(lens, inputSize);
+  std::vector<cv::Point2f> row(mapX.cols);
+
+  for (int y = 0; y < mapX.rows; y++)
+  {
+    float *mx = mapX.ptr<float>(y), *my = mapY.ptr<float>(y);
+    for (int x = 0; x < mapX.cols; x++)
+      row[x] = cv::Point2f(mx[x], my[x]);
+    distortPoints(row, k, lens);
+    for (int x = 0; x < mapX.cols; x++) {
+      mx[x] = row[x].x;
+      my[x] = row[x].y;
+    }
+  }
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// maps
+
+Mat scaledProjection(const Mat &projection, Size inputSize, Size scaledSize)
+{
+  Mat p;
+  projection.convertTo(p, CV_64F);
+  if (inputSize == scaledSize) return p;
+  double sx = (double)scaledSize.width / inputSize.width,
+         sy = (double)scaledSize.height / inputSize.height;
+  // same pixel center convention as cv::resize
+  Mat scale = (cv::Mat_<double>(3,3) <<
+    sx, 0,  0.5*sx - 0.5,
+    0,  sy, 0.5*sy - 0.5,
+    0,  0,  1);
+  return p * scale;
+}
+
+Maps perspectiveMaps(const Mat &projection, Size inputSize, Size outputSize, const Lens &lens)
+{
+  // same as warpPerspective: projection maps input -> output, for the lookup
+  // table we need the inverse
+  Mat inv;
+  projection.convertTo(inv, CV_64F);
+  inv = inv.inv();
+  const double *h = inv.ptr<double>();
+
+  Mat mapX(outputSize, CV_32FC1), mapY(outputSize, CV_32FC1);
+  for (int y = 0; y < outputSize.height; y++)
+  {
+    float *mx = mapX.ptr<float>(y), *my = mapY.ptr<float>(y);
+    for (int x = 0; x < outputSize.width; x++)
+    {
+      double w = h[6]*x + h[7]*y + h[8];
+      w = w ? 1.0/w : 0;
+      mx[x] = (float)((h[0]*x + h[1]*y + h[2])*w);
+      my[x] = (float)((h[3]*x + h[4]*y + h[5])*w);
+    }
+  }
+
+  if (!lens.empty()) distortMaps(mapX, mapY, lens, inputSize);
+
+  Maps maps;
+  maps.roi = inputRoi(projection, inputSize, outputSize, lens);
+  mapX -= maps.roi.x;
+  mapY -= maps.roi.y;
+  Mat unused;
+  cv::convertMaps(mapX, mapY, maps.xy, maps.interp, CV_16SC2);
+  cv::convertMaps(mapX, mapY, maps.xyNearest, unused, CV_16SC2, true);
+  maps.weights = Mat::zeros(maps.roi.size(), CV_32FC1);
+  cv::Rect inRoi(cv::Point(), maps.roi.size());
+  for (int y = 0; y < outputSize.height; y++)
+  {
+    const short *xy = maps.xyNearest.ptr<short>(y);
+    for (int x = 0; x < outputSize.width; x++, xy += 2)
+      if (inRoi.contains(cv::Point(xy[0], xy[1])))
+        maps.weights.at<float>(xy[1], xy[0]) += 1;
+  }
+  maps.inputSize = inputSize;
+  maps.outputSize = outputSize;
+  return maps;
+}
+
+cv::Rect inputRoi(const Mat &projection, Size inputSize, Size outputSize, const Lens &lens)
+{
+  // the border is sampled, with lens distortion the edges in between can
+  // bulge a bit. The margin also keeps the bilinear neighbours inside.
+  const int margin = 2;
+  cv::Rect frame(cv::Point(), inputSize),
+           r = cv::boundingRect(outline(projection, inputSize, outputSize, lens, 16));
+  r = cv::Rect(r.x - margin, r.y - margin, r.width + 2*margin, r.height + 2*margin) & frame;
+  // the table is not in the frame at all (or the projection is garbage),
+  // nothing to save then
+  return r.area() > 0 ? r : frame;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+// cache
+
+const size_t maxCachedMaps = 8;
+std::mutex mapsMutex;
+std::map<std::string, Maps> mapsCache;
+std::map<std::string, cv::Rect> roiCache;
+std::map<std::string, Mat> weightsCache;
+
+void appendKey(std::string &key, const Mat &m)
+{
+  if (m.empty()) { key += '-'; return; }
+  Mat d;
+  m.convertTo(d, CV_64F);
+  key.append((const char*)d.data, d.total() * d.elemSize());
+}
+
+void appendKey(std::string &key, Size s)
+{
+  key.append((const char*)&s.width, sizeof(s.width));
+  key.append((const char*)&s.height, sizeof(s.height));
+}
+
+std::string cacheKey(const Mat &projection, Size inputSize, Size outputSize, const Lens &lens)
+{
+  std::string key;
+  appendKey(key, projection);
+  appendKey(key, inputSize);
+  appendKey(key, outputSize);
+  appendKey(key, lens.cameraMatrix);
+  appendKey(key, lens.distCoeffs);
+  appendKey(key, lens.imageSize);
+  return key;
+}
+
+cv::Rect cachedInputRoi(const Mat &projection, Size inputSize, Size outputSize, const Lens &lens)
+{
+  std::string key = cacheKey(projection, inputSize, outputSize, lens);
+  std::lock_guard<std::mutex> lock(mapsMutex);
+  auto it = roiCache.find(key);
+  if (it != roiCache.end()) return it->second;
+  if (roiCache.size() >= maxCachedMaps) roiCache.clear();
+  cv::Rect roi = inputRoi(projection, inputSize, outputSize, lens);
+  roiCache.insert({key, roi});
+  return roi;
+}
+
+Mat cachedAreaWeights(const Mat &projection, Size inputSize, Size outputSize, const Lens &lens)
+{
+  cv::Rect roi = cachedInputRoi(projection, inputSize, outputSize, lens);
+  std::string key = cacheKey(projection, inputSize, outputSize, lens);
+  std::lock_guard<std::mutex> lock(mapsMutex);
+  auto it = weightsCache.find(key);
+  if (it != weightsCache.end()) return it->second;
+  if (weightsCache.size() >= maxCachedMaps) weightsCache.clear();
+  Mat weights = areaWeights(projection, inputSize, outputSize, roi, lens);
+  weightsCache.insert({key, weights});
+  return weights;
+}
+
+Maps cachedPerspectiveMaps(const Mat &projection, Size inputSize, Size outputSize, const Lens &lens)
+{
+  std::string key = cacheKey(projection, inputSize, outputSize, lens);
+
+  std::lock_guard<std::mutex> lock(mapsMutex);
+  auto it = mapsCache.find(key);
+  if (it != mapsCache.end()) return it->second;
+
+  // projections change rarely, when they do the old ones are garbage
+  if (mapsCache.size() >= maxCachedMaps) mapsCache.clear();
+  Maps maps = perspectiveMaps(projection, inputSize, outputSize, lens);
+  mapsCache.insert({key, maps});
+  return maps;
+}
+
+// -=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-=-
+
+void apply(const Mat &in, Mat &out, const Maps &maps, int interpolation)
+{
+  // the fixed point maps are truncated, for nearest neighbor sampling we
+  // need the rounded ones
+  bool nearest = interpolation == cv::INTER_NEAREST;
+  const Mat &xy = nearest ? maps.xyNearest : maps.xy,
+            &interp = nearest ? Mat() : maps.interp;
+  Mat src = in.size() == maps.roi.size() ? in : Mat(in, maps.roi);
+  if (in.data == out.data) {
+    Mat result;
+    cv::remap(src, result, xy, interp, interpolation);
+    out = result;
+  } else {
+    cv::remap(src, out, xy, interp, interpolation);
+  }
+}
+
+template<typename T>
+double weightedSquares(const Mat &in, const Mat &weights)
+{
+  double sum = 0;
+  for (int y = 0; y < in.rows; y++)
+  {
+    const T *v = in.ptr<T>(y);
+    const float *w = weights.ptr<float>(y);
+    for (int x = 0; x < in.cols; x++) sum += (double)v[x] * v[x] * w[x];
+  }
+  return sum;
+}
+
+double warpedNorm(const Mat &in, const Maps &maps)
+{
+  return warpedNorm(in, maps.weights);
+}
+
+double warpedNorm(const Mat &in, const Mat &weights)
+{
+  CV_Assert(in.channels() == 1 && in.size() == weights.size());
+  // depth diffs are 16 bit, no need to convert those
+  if (in.depth() == CV_16U) return std::sqrt(weightedSquares<ushort>(in, weights));
+  Mat values;
+  in.convertTo(values, CV_32F);
+  return std::sqrt(weightedSquares<float>(values, weights));
+}
+
+Mat areaWeights(const Mat &projection, Size inputSize, Size outputSize, cv::Rect roi, const Lens &lens)
+{
+  // The output pixels that sample an input pixel are about the area of that
+  // pixel in the output: the parallelogram its right and lower neighbours
+  // span there. Pixel centers that land outside the output get none.
+  Mat weights(roi.size(), CV_32FC1);
+  float right = outputSize.width - 0.5f, bottom = outputSize.height - 0.5f;
+  std::vector<cv::Point2f> row(roi.width + 1), next(roi.width + 1), tfmedRow, tfmedNext;
+  auto project = [&](int y, std::vector<cv::Point2f> &pts, std::vector<cv::Point2f> &tfmed) {
+    for (int x = 0; x <= roi.width; x++) pts[x] = cv::Point2f(roi.x + x, roi.y + y);
+    transformPoints(pts, tfmed, projection, inputSize, lens);
+  };
+  project(0, row, tfmedRow);
+  for (int y = 0; y < roi.height; y++)
+  {
+    project(y + 1, next, tfmedNext);
+    float *w = weights.ptr<float>(y);
+    for (int x = 0; x < roi.width; x++)
+    {
+      cv::Point2f p = tfmedRow[x];
+      bool inside = p.x >= -0.5f && p.x < right && p.y >= -0.5f && p.y < bottom;
+      w[x] = inside ? std::abs((tfmedRow[x+1] - p).cross(tfmedNext[x] - p)) : 0;
+    }
+    std::swap(tfmedRow, tfmedNext);
+  }
+  return weights;
+}
+
+void transformPoints(const std::vector<cv::Point2f> &in, std::vector<cv::Point2f> &out, const Mat &projection, Size inputSize, const Lens &lens)
+{
+  if (in.empty()) { out.clear(); return; }
+  std::vector<cv::Point2f> undistorted = in;
+  if (!lens.empty()) {
+    Mat k = scaledCameraMatrix(lens, inputSize);
+    cv::undistortPoints(in, undistorted, k, lens.distCoeffs, cv::noArray(), k);
+  }
+  Mat p;
+  projection.convertTo(p, CV_64F);
+  cv::perspectiveTransform(undistorted, out, p);
+}
+
+std::vector<cv::Point> outline(const Mat &projection, Size inputSize, Size outputSize, const Lens &lens, int step)
+{
+  // walk around the output rectangle, clockwise from the top left corner
+  float w = outputSize.width, h = outputSize.height;
+  std::vector<cv::Point2f> border;
+  for (float x = 0; x < w; x += step) border.push_back(cv::Point2f(x, 0));
+  for (float y = 0; y < h; y += step) border.push_back(cv::Point2f(w, y));
+  for (float x = w; x > 0; x -= step) border.push_back(cv::Point2f(x, h));
+  for (float y = h; y > 0; y -= step) border.push_back(cv::Point2f(0, y));
+
+  Mat p;
+  projection.convertTo(p, CV_64F);
+  std::vector<cv::Point2f> inInput;
+  cv::perspectiveTransform(border, inInput, p.inv());
+  if (!lens.empty()) distortPoints(inInput, scaledCameraMatrix(lens, inputSize), lens);
+
+  std::vector<cv::Point> result;
+  for (auto pt : inInput) result.push_back(pt);
+  return result;
+}
+
+void undistort(const Mat &in, Mat &out, const Lens &lens)
+{
+  if (lens.empty()) { if (&in != &out) out = in; return; }
+  Mat result;
+  cv::undistort(in, result, scaledCameraMatrix(lens, in.size()), lens.distCoeffs);
+  out = result;
+}
+
+} // warp
+} // vision
@@ -0,0 +1,88 @@
+#ifndef WARP_MAPS_H_
+#define WARP_MAPS_H_
+
+/*
+warpPerspective has to invert the homography for every pixel of every frame.
+For a stream the projection does not change, so we do that work once: the
+(optionally lens-undistorted) projection is baked into fixed-point remap
+tables that cv::remap can apply with a simple per-pixel lookup.
+
+The table usually covers only part of the camera image. The maps know that
+part (roi) and their coordinates are relative to it, so callers can crop
+frames to it before doing any other per-pixel work on them.
+*/
+
+#include <opencv2/opencv.hpp>
+
+namespace vision {
+namespace warp {
+
+// Intrinsics of the camera an image came from. Empty means the image is
+// treated as distortion free.
+struct Lens
+{
+  cv::Mat cameraMatrix;
+  cv::Mat distCoeffs;
+  cv::Size imageSize; // resolution the calibration was done at
+  bool empty() const { return cameraMatrix.empty(); };
+};
+
+struct Maps
+{
+  cv::Mat xy;     // CV_16SC2, integer source coordinates
+  cv::Mat interp; // CV_16UC1, index into the interpolation table
+  cv::Mat xyNearest; // CV_16SC2, rounded source coordinates for INTER_NEAREST
+  cv::Rect roi;   // part of the input the maps read, source coordinates are relative to it
+  cv::Mat weights; // CV_32FC1 over roi, how many output pixels read an input pixel (nearest)
+  cv::Size inputSize;
+  cv::Size outputSize;
+  bool empty() const { return xy.empty(); };
+};
+
+// For frames of inputSize when projection was made for frames of scaledSize:
+// the resize becomes part of the homography so we only resample once
+cv::Mat scaledProjection(const cv::Mat &projection, cv::Size inputSize, cv::Size scaledSize);
+
+Maps perspectiveMaps(const cv::Mat &projection, cv::Size inputSize, cv::Size outputSize, const Lens &lens = Lens());
+
+// The part of an input frame the projection actually uses: bounding box of
+// the output rectangle mapped back into the input, clipped to inputSize
+cv::Rect inputRoi(const cv::Mat &projection, cv::Size inputSize, cv::Size outputSize, const Lens &lens = Lens());
+cv::Rect cachedInputRoi(const cv::Mat &projection, cv::Size inputSize, cv::Size outputSize, const Lens &lens = Lens());
+
+// Same as perspectiveMaps but remembers the tables per projection, sizes and
+// lens so that building them is only paid once per stream.
+Maps cachedPerspectiveMaps(const cv::Mat &projection, cv::Size inputSize, cv::Size outputSize, const Lens &lens = Lens());
+
+// in can be the whole input frame or the maps.roi crop of it
+void apply(const cv::Mat &in, cv::Mat &out, const Maps &maps, int interpolation = cv::INTER_LINEAR);
+
+// The L2 norm in would have after apply with INTER_NEAREST, without warping
+// it: every pixel counts as often as the output samples it (maps.weights).
+// in is the maps.roi crop, one channel
+double warpedNorm(const cv::Mat &in, const Maps &maps);
+// Same with weights of the size of in, e.g. from areaWeights
+double warpedNorm(const cv::Mat &in, const cv::Mat &weights);
+
+// What maps.weights counts, without building the maps: over roi of the
+// input, the area the projection gives every pixel in the output (0 outside
+// of it). For callers that do not warp frames but need their warped norm.
+cv::Mat areaWeights(const cv::Mat &projection, cv::Size inputSize, cv::Size outputSize, cv::Rect roi, const Lens &lens = Lens());
+cv::Mat cachedAreaWeights(const cv::Mat &projection, cv::Size inputSize, cv::Size outputSize, const Lens &lens = Lens());
+
+// The sparse counterpart of apply: moves points of an input frame into the
+// projection's output space
+void transformPoints(const std::vector<cv::Point2f> &in, std::vector<cv::Point2f> &out, const cv::Mat &projection, cv::Size inputSize, const Lens &lens = Lens());
+
+// The border of the output rectangle in input frame coordinates, sampled
+// every step pixels (lens distortion bends the edges)
+std::vector<cv::Point> outline(const cv::Mat &projection, cv::Size inputSize, cv::Size outputSize, const Lens &lens = Lens(), int step = 32);
+
+// With a lens the projection is expected in undistorted camera coordinates,
+// so images used to find it need to go through this first
+void undistort(const cv::Mat &in, cv::Mat &out, const Lens &lens);
+
+}
+}
+
+#endif  // WARP_MAPS_H_